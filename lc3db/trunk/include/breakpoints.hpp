@@ -23,9 +23,12 @@
 #include <string>
 #include <list>
 #include <set>
+#include <map>
+#include <vector>
 #include <stdint.h>
 
 #include "source_info.hpp"
+#include "expression.hpp"
 
 enum BreakpointDisposition
 {
@@ -48,8 +51,7 @@ typedef std::list<Breakpoint*>::iterator BreakpointIterator;
 
 class UserBreakpoits {
 public:
-  UserBreakpoits(SourceInfo &_src_info) :
-    src_info(_src_info), last_id(0) {};
+  UserBreakpoits(SourceInfo &_src_info);
   // ~UserBreakpoits();
 /*
   Usage:
@@ -61,13 +63,34 @@ public:
   * Hit: Check for active breakpoint at address
  */
   int addWatch(uint16_t address, bool temp, BreakpointKind kind);
-  int add(uint16_t address, bool temp);
+  // Stops when the value of the expression changes (the breakpoint owns it).
+  // An expression on the locals of the frame at depth (of the CallStack) is
+  // only evaluated in that frame, and deleted when the frame returns.
+  int addWatch(Expression *expression, size_t depth);
+  // Stops only if the condition is not zero (the breakpoint owns it)
+  int add(uint16_t address, bool temp, Expression *condition = NULL);
+  // Id of the first breakpoint at the address, 0 if none
+  int find(uint16_t address);
   int add(uint16_t address, std::string fileName, int lineNo);
   int erase(int id);
   int setEnabled(int id, bool enable,bool setDisp, BreakpointDisposition disp);
   int setIgnoreCount(int id, int count);
   int setOnHit(int id, BreakpointDisposition disp);
-  int check(uint16_t address);
+  // Called before each instruction, only a bit test unless an enabled
+  // breakpoint is at the address
+  int check(uint16_t address) {
+    if (!(active[address >> 5] & (1u << (address & 31)))) {
+      return 0;
+    }
+    return hit(address);
+  }
+  // Called when the program is started, false if no breakpoint is enabled
+  bool breaking() const { return active_count != 0; }
+  // Called after each instruction, true while there are watched expressions
+  bool watching() const { return !value_watches.empty(); }
+  // Id of the first watch changed (or gone out of scope), at depth of the
+  // CallStack
+  int checkWatches(size_t depth);
   void showInfo();
 
 private:
@@ -76,12 +99,19 @@ private:
   // watchpoints
   std::set<uint16_t> w_watchpoints;
   std::set<uint16_t> r_watchpoints;
-  // Active breakpoints for quick check before each execution cycle
-  // Note that we don't support multiple breakpoints for same location (even though gdb does it).
-  // Multiple breakpoints at same location don't make much sense without conditional breakpoints (which are not supported here).
-  std::set<uint16_t> active_breakpoints;
+  // Active breakpoints for quick check before each execution cycle: a bit
+  // per address, set while an enabled breakpoint is there.  There can be
+  // several breakpoints for the same location (like in gdb).
+  uint32_t active[0x10000 / 32];
+  int active_count;	// bits set in active
+  typedef std::multimap<uint16_t, Breakpoint*> address_map_t;
+  address_map_t by_address; // breakpoints (not watchpoints) by address
   std::list<Breakpoint*> breakpoints; // Full information about user breakpoints
-  BreakpointIterator lookupA(uint16_t address);
+  // enabled watched expressions, evaluated after each instruction
+  std::vector<Breakpoint*> value_watches;
+  int hit(uint16_t address);
+  void update_active(uint16_t address);
+  void update_watches();
   BreakpointIterator lookupI(int id);
   int erase(BreakpointIterator it);
   int setEnabled(BreakpointIterator it, bool enable, bool setDisp, BreakpointDisposition disp);
@@ -0,0 +1,141 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+
+#ifndef _CALL_STACK_HPP
+#define _CALL_STACK_HPP
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+
+// Calls in progress, pushed and popped while the instructions are executed
+// (JSR, JSRR, TRAP and the interrupts, returned from by RET or RTI), so the
+// backtrace needs neither the frame links of the C code nor the memory.
+// The frames popped by the returns are kept as long as the steps of the
+// reverse execution, which puts them back.
+class CallStack
+{
+public:
+  struct Frame
+  {
+    uint16_t site;		// the call, or the interrupted instruction
+    uint16_t target;		// first address of the called routine
+    uint16_t return_address;
+    uint16_t frame_pointer;	// R5 of the caller
+    bool interrupt;
+    uint64_t start;		// clock at the call, see Profiler::clock()
+  };
+
+  // Told of the frames as the returns unwind them, see Profiler
+  struct Listener
+  {
+    virtual ~Listener() { }
+    virtual void returned(const Frame &frame, uint64_t count) = 0;
+  };
+
+  CallStack() { }
+
+  // Frames, the outermost first
+  size_t depth() const { return stack.size(); }
+  const Frame &operator[](size_t i) const { return stack[i]; }
+
+  void clear() {
+    stack.clear();
+    popped.clear();
+    returns.clear();
+  }
+
+  // After the instruction at pc, a call or a return as told by the
+  // depth_change() of the CPU, went to next_pc, and the interrupt, if any,
+  // went to new_pc (R5 is frame_pointer), the clock at count.  The last
+  // `history' returns are kept to be undone, the listener is told of the
+  // frames they unwind.
+  void executed(uint16_t pc, int calls, uint16_t next_pc, uint16_t new_pc,
+		uint16_t frame_pointer, size_t history, uint64_t count,
+		Listener *listener) {
+    if (calls > 0) {
+      call(pc, next_pc, pc + 1, frame_pointer, false, count);
+    } else if (calls < 0) {
+      returned(next_pc, history, count, listener);
+    }
+    if (new_pc != next_pc) {
+      call(next_pc, new_pc, next_pc, frame_pointer, true, count);
+    }
+  }
+
+  // The reverse execution undid a call or an interrupt
+  void undo_call() {
+    if (!stack.empty()) {
+      stack.pop_back();
+    }
+  }
+  // The reverse execution undid a return
+  void undo_return() {
+    if (returns.empty()) {
+      return;
+    }
+    for (int n = returns.back(); n > 0; n--) {
+      stack.push_back(popped.back());
+      popped.pop_back();
+    }
+    returns.pop_back();
+  }
+
+private:
+  enum { MAX_DEPTH = 0x10000 };
+
+  void call(uint16_t site, uint16_t target, uint16_t return_address,
+	    uint16_t frame_pointer, bool interrupt, uint64_t start) {
+    if (stack.size() == MAX_DEPTH) {
+      // runaway recursion (or calls never returning), forget the oldest
+      stack.pop_front();
+    }
+    Frame f = { site, target, return_address, frame_pointer, interrupt, start };
+    stack.push_back(f);
+  }
+
+  // A return to the address of a frame unwinds the frames above it, one
+  // to elsewhere (a jump by RET) leaves the stack as it is
+  void returned(uint16_t address, size_t history, uint64_t count, Listener *listener) {
+    size_t n = stack.size();
+    while (n > 0 && stack[n - 1].return_address != address) {
+      n--;
+    }
+    int unwound = (n > 0) ? stack.size() - n + 1 : 0;
+    for (int i = 0; i < unwound; i++) {
+      if (listener) {
+	listener->returned(stack.back(), count);
+      }
+      popped.push_back(stack.back());
+      stack.pop_back();
+    }
+    returns.push_back(unwound);
+    while (returns.size() > history) {
+      popped.erase(popped.begin(), popped.begin() + returns.front());
+      returns.pop_front();
+    }
+  }
+
+  std::deque<Frame> stack;
+  std::deque<Frame> popped;	// unwound by the returns, the last on top
+  std::deque<int> returns;	// frames unwound by each return
+};
+
+#endif
@@ -0,0 +1,54 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#ifndef _CHECKPOINT_HPP
+#define _CHECKPOINT_HPP
+
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "hardware.hpp"
+
+// State of the whole machine: the registers, a copy-on-write snapshot of
+// the memory and the device registers.  Can be restored any number of
+// times, e.g. to run several programs from one booted operating system.
+class Checkpoint
+{
+public:
+  Checkpoint(LC3::CPU &cpu, Memory &mem, Hardware &hw);
+  ~Checkpoint();
+  void restore();
+
+private:
+  Checkpoint(const Checkpoint &);
+
+  LC3::CPU &cpu;
+  Memory &mem;
+  Hardware &hw;
+
+  uint16_t PC;
+  uint16_t PSR;
+  int16_t R[8];
+  uint16_t USP;
+  uint16_t SSP;
+  int depth;
+  Memory::Snapshot *snapshot;
+  Hardware::State hw_state;
+};
+
+#endif
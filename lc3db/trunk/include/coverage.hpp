@@ -0,0 +1,91 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#ifndef _COVERAGE_HPP
+#define _COVERAGE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <stdint.h>
+
+#include "memory.hpp"
+#include "source_info.hpp"
+
+// Executed addresses of one run: a byte per address, telling whether the
+// instruction continued with the next address, jumped elsewhere, or both
+// (a conditional branch taken both ways).
+class Coverage
+{
+public:
+  Coverage() : flags(0x10000) { }
+
+  void reset();
+
+  // After the instruction at pc, before an interrupt is taken
+  void executed(uint16_t pc, uint16_t next_pc) {
+    flags[pc] |= (next_pc == (uint16_t)(pc + 1)) ? FELL_THROUGH : JUMPED;
+  }
+
+  bool was_executed(uint16_t pc) const { return flags[pc] != 0; }
+  bool fell_through(uint16_t pc) const { return flags[pc] & FELL_THROUGH; }
+  bool jumped(uint16_t pc) const { return flags[pc] & JUMPED; }
+
+private:
+  enum { FELL_THROUGH = 1, JUMPED = 2 };
+
+  std::vector<uint8_t> flags;
+};
+
+// Line, function and branch coverage of the source files summed over the
+// runs, read and written in the tracefile format of lcov.  The counts are
+// the numbers of runs covering a line or a branch.
+class CoverageReport
+{
+public:
+  // Adds a run of the program described by src_info (mem holds its code)
+  void add(const Coverage &coverage, SourceInfo &src_info, Memory &mem);
+
+  // Adds the counts of an existing tracefile
+  bool read(const char *file_name);
+  bool write(const char *file_name, const char *test_name);
+
+private:
+  enum { NOT_EXECUTED = -1 };	// a branch never reached, "-" in the file
+
+  struct Branch
+  {
+    int64_t taken, not_taken;
+    Branch() : taken(NOT_EXECUTED), not_taken(NOT_EXECUTED) { }
+  };
+
+  struct File
+  {
+    std::map<int, uint64_t> lines;			// line => count
+    std::map<std::string, std::pair<int, uint64_t> > functions; // name => (line, count)
+    std::map<std::pair<int, int>, Branch> branches;	// (line, block in the line)
+  };
+
+  static void add_branch(int64_t &total, int64_t count);
+
+  std::map<std::string, File> files;
+};
+
+#endif
@@ -25,13 +25,28 @@
 
 namespace LC3 {
 
-class CPU
+class CPU;
+
+// Does the TRAP routines natively instead of the OS, see
+// CPU::set_trap_handler()
+struct TrapHandler
+{
+  virtual ~TrapHandler() { };
+  // TRAP vector executed, R7 already holds the return address.  Returns
+  // false to call the routine of the trap vector table instead.
+  virtual bool trap(CPU &cpu, uint16_t vector) = 0;
+};
+
+class CPU : private CodeWatcher
 {
 public:
   CPU(Memory &mem);
+  ~CPU();
   void cycle();
   void decode(uint16_t IR);
   void interrupt(uint16_t signal, uint16_t priority);
+  // NULL runs every TRAP through the vector table
+  void set_trap_handler(TrapHandler *handler) { trap_handler = handler; }
 
   uint16_t PC;
   uint16_t PSR;
@@ -39,7 +54,57 @@ public:
   uint16_t USP;
   uint16_t SSP;
 
+  // Calls (JSR, JSRR, TRAP, interrupts and exceptions) minus returns (RET,
+  // RTI) executed, for stepping over the calls and `finish'
+  int depth;
+
+  // Change of the depth by the instruction IR: 1 call, -1 return, else 0
+  static int depth_change(uint16_t IR) { return decoded[IR].calls; }
+  // Same for the instruction IR at pc which continued at next_pc: a TRAP
+  // done by the trap handler returned at once
+  static int depth_change(uint16_t IR, uint16_t pc, uint16_t next_pc) {
+    return ((IR & 0xF000) == 0xF000 && next_pc == (uint16_t)(pc + 1)) ? 0 : decoded[IR].calls;
+  }
+
 private:
+  // Predecoded instruction: the handler for the matching OP() of the
+  // architecture definition and the operand fields extracted from IR.
+  struct Decoded;
+  typedef void (CPU::*Handler)(const Decoded &op);
+  struct Decoded
+  {
+    Handler exec;
+    int16_t dr, sr, sr1, sr2, base, imm, vec;
+    bool ends_block;	// control transfer (or exception)
+    int8_t calls;	// see depth_change()
+  };
+
+  // One specialization per OP(), keyed by its line in the definition file
+  template <int OP_LINE> void execute(const Decoded &op);
+  void predecode();
+
+  // Indexed by instruction word, filled once by the first CPU instance
+  // (shared by the CPUs of all threads)
+  static Decoded decoded[0x10000];
+  static bool is_predecoded;
+
+  // Straight-line run of instructions, up to the first control transfer
+  enum { MAX_BLOCK = 32 };
+  struct Block
+  {
+    uint16_t start;
+    uint16_t length;
+    const Decoded *ops[MAX_BLOCK];
+  };
+
+  Block *translate(uint16_t address);
+  void code_modified(uint16_t address);
+
+  Block **blocks;	// block cache indexed by the start address
+  Block *block;		// block executed by cycle(), NULL if left
+  uint16_t block_index;	// position of the next instruction in block
+
+  TrapHandler *trap_handler;
   Memory &mem;
 };
 
@@ -0,0 +1,67 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#ifndef _DEBUG_INFO_FILE_HPP
+#define _DEBUG_INFO_FILE_HPP
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+class SourceInfo;
+
+// Debug information in the indexed binary format written by `lc3as -x'
+// (FILE.dbgx, described in lc3tools/dbgx.h), mapped into memory.  The
+// symbols and the scopes are decoded when the file is loaded, the line
+// table only by the first source lookup.
+class DebugInfoFile
+{
+public:
+  DebugInfoFile(const std::string &file_name);
+  ~DebugInfoFile();
+
+  // The file exists and is well formed
+  bool is_open() const { return data != NULL; }
+  const std::string &name() const { return file_name; }
+  // Has the line information of C sources (not only of the assembly)
+  bool has_HLL_source() const;
+
+  // Adds the symbols, functions, blocks and variables to src_info, which
+  // takes over the file to add its lines when they are needed
+  void load(SourceInfo &src_info);
+  // Adds the lines of the assembly source, and of the C sources if HLL
+  void load_lines(SourceInfo &src_info, bool HLL) const;
+
+private:
+  DebugInfoFile(const DebugInfoFile &);
+
+  enum {
+    STRINGS = 1, FILES, SYMBOLS, TYPES, SCOPES, LINES, NUM_SECTIONS = LINES
+  };
+
+  const char *string(uint32_t offset) const;
+
+  std::string file_name;
+  unsigned char *data;	// mapped file, NULL if not open
+  size_t size;
+  const unsigned char *sections[NUM_SECTIONS + 1];
+  size_t section_sizes[NUM_SECTIONS + 1];
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#ifndef _EXPRESSION_HPP
+#define _EXPRESSION_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "memory.hpp"
+#include "cpu.hpp"
+#include "source_info.hpp"
+
+// Expression of the conditional breakpoints and watchpoints.  It is parsed
+// once, the names are resolved against the debug information of the scope,
+// and it is compiled into a short list of register machine instructions,
+// so evaluating it between two instructions of the simulation is cheap.
+//
+// Operands: numbers (12, x3000, 0x3000, #12), C variables, assembler labels
+// (the word at the label), registers (R0-R7, PC, PSR, MCR), *ADDRESS and
+// &VARIABLE.  Operators as in C, the arithmetic is on 16 bit signed words.
+// The device registers but MCR read as 0, not to run the side effects of
+// their reads (a key taken from the keyboard...) on every evaluation.
+class Expression
+{
+public:
+  // NULL (after printing why) if the text is not a valid expression
+  static Expression *compile(const std::string &text, SourceInfo &src_info,
+			     uint16_t scope, LC3::CPU &cpu, Memory &mem);
+
+  int16_t value() const;
+  const std::string &text() const { return source; }
+  // True if it has C locals or parameters, relative to R5
+  bool frame_relative() const;
+
+private:
+  enum Opcode {
+    CONST,		// dst = imm
+    REG,		// dst = register imm (R0-R7, PC, PSR)
+    LOAD_ABS,		// dst = mem[imm]
+    LOAD_FRAME,		// dst = mem[R5 + imm]
+    ADDR_FRAME,		// dst = R5 + imm
+    LOAD,		// dst = mem[a]
+    NEG, NOT, LNOT,	// dst = op a
+    ADD, SUB, MUL, DIV, MOD, SHL, SHR, AND, OR, XOR,
+    EQ, NE, LT, LE, GT, GE, LAND, LOR
+  };
+  struct Instruction
+  {
+    uint8_t op;
+    uint8_t dst, a, b;
+    int16_t imm;
+  };
+  enum { MAX_REGS = 16 };
+
+  Expression(const std::string &text, LC3::CPU &cpu, Memory &mem) :
+    source(text), cpu(cpu), mem(mem) { }
+
+  int16_t load(uint16_t address) const;
+
+  std::string source;
+  std::vector<Instruction> code;	// the result is left in register 0
+  LC3::CPU &cpu;
+  Memory &mem;
+
+  friend class ExpressionParser;
+};
+
+#endif
@@ -17,6 +17,9 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 \*/
 
+#ifndef _HARDWARE_HPP
+#define _HARDWARE_HPP
+
 #include "memory.hpp"
 #include "cpu.hpp"
 
@@ -26,9 +29,37 @@ public:
   Hardware(Memory &mem, LC3::CPU &cpu);
   ~Hardware();
   void set_tty(int fd);
+  // A stdin shared with the debugger commands is read one key at a time,
+  // unless the program has it exclusively
+  void set_tty(int ifd, int ofd, bool exclusive = false);
+  // The machine runs while MCR bit 15 is set
+  bool halted();
+  // Write out the buffered display output
+  void flush();
+  void set_buffered_output(bool buffered);
+  // GETC, OUT, PUTS and IN done by the simulator instead of the
+  // routines of the OS (a breakpoint in the routines is not hit then)
+  void set_native_traps(bool native);
+  // Takes the vector table as the one of the OS just loaded: the native
+  // TRAPs are done only while x20-x24 still point to the routines of the OS
+  void record_os_traps();
+
+  // Device registers not held in the memory, saved along with a
+  // Memory::Snapshot to rewind the whole machine
+  struct State
+  {
+    int16_t mcr;
+    uint16_t ccr;
+    uint64_t ccr_written;
+    unsigned char last_key;
+  };
+  void save(State &state);
+  void restore(const State &state);
 private:
   class Implementation;
   Hardware(const Hardware &);
 
   Implementation *impl;
 };
+
+#endif
@@ -24,6 +24,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
 #include <stdint.h>
 
 class MappedWord;
@@ -37,27 +38,95 @@ struct Word
   Word &operator=(int16_t rhs);
 
 private:
+  Memory &mem;
+  uint16_t address;
   int16_t &value;
   MappedWord *mapped;
 };
 
+// Notified when a word marked with Memory::mark_code() is modified
+struct CodeWatcher
+{
+  virtual ~CodeWatcher() { };
+  virtual void code_modified(uint16_t address) = 0;
+};
+
 class Memory {
 public:
   Memory();
   ~Memory();
 
   Word operator[](uint16_t index);
+  int16_t read(uint16_t index);
   uint16_t load(const std::string &filename);
-  void cycle();
   void register_dma(uint16_t address, MappedWord *word);
 
+  // Device scheduler: cycle() is called once per executed instruction and
+  // runs MappedWord::cycle() of the devices whose event is due
+  void cycle() { if (++now >= next_event) run_events(); }
+  uint64_t cycles() const { return now; }
+  void schedule(MappedWord *word, uint64_t when);
+  void cancel(MappedWord *word);
+  bool is_mapped(uint16_t index);
+
+  void set_code_watcher(CodeWatcher *watcher);
+  void mark_code(uint16_t index) { code[index] = 1; }
+
+  // Copy-on-write snapshots of the content (and of the scheduled device
+  // events).  Taking one copies nothing, a page is copied on its first
+  // write after the snapshot and restore() only copies those pages back.
+  // The snapshots have to be deleted before the Memory.
+  class Snapshot;
+  Snapshot *snapshot();
+  void restore(const Snapshot *snapshot);
+
 private:
+  struct Page;
+  typedef std::multimap<uint64_t, MappedWord *> event_queue_t;
+
+  bool is_device_page(uint16_t index) { return device_page[index >> 8]; }
+  // Save the page for the snapshots still sharing it, before a write
+  void before_write(uint16_t index) {
+    if (page_epoch[index >> 8] < snapshot_epoch) preserve(index >> 8);
+  }
+  void preserve(int page);
+  void release(Snapshot *snapshot);
   MappedWord *mapped_word(uint16_t index);
+  void code_written(uint16_t index);
+  void run_events();
   typedef std::map<uint16_t, MappedWord *> dma_map_t;
   dma_map_t dma;
+  event_queue_t events;	// ordered by the cycle they are due
+  uint64_t now;
+  uint64_t next_event;	// cycle of the first event, or never
   friend class Word;
 
   int16_t *mem;
+  bool device_page[0x100];	// pages with a registered device (slow path)
+  uint8_t *code;	// words decoded by the code watcher
+  CodeWatcher *code_watcher;
+
+  std::list<Snapshot *> snapshots;
+  unsigned last_epoch;		// of the latest snapshot taken
+  unsigned snapshot_epoch;	// of the latest snapshot alive, 0 if none
+  unsigned page_epoch[0x100];	// snapshot_epoch when the page was preserved
+};
+
+class Memory::Snapshot
+{
+public:
+  ~Snapshot();
+
+private:
+  friend class Memory;
+  Snapshot(Memory &mem, unsigned epoch);
+  Snapshot(const Snapshot &);
+
+  Memory &mem;
+  unsigned epoch;
+  Page *pages[0x100];	// NULL while the page in memory is unchanged
+  uint64_t now;
+  event_queue_t events;
 };
 
 struct MappedWord
@@ -65,7 +134,59 @@ struct MappedWord
   virtual ~MappedWord() = 0;
   virtual operator int16_t() const { return 0; };
   virtual MappedWord &operator=(int16_t rhs) { return *this; };
+  // Called at the cycle requested with Memory::schedule()
   virtual void cycle() { };
 };
 
+// Every load, store and fetch goes through these, the device lookup is
+// only done for the pages marked by register_dma()
+inline Word::Word(Memory &mem, uint16_t address)
+  : mem(mem), address(address), value(mem.mem[address]),
+    mapped(mem.is_device_page(address) ? mem.mapped_word(address) : 0)
+{
+}
+
+inline Word::operator int16_t() const
+{
+  if (mapped) {
+    return *mapped;
+  }
+
+  return value;
+}
+
+inline Word &Word::operator=(int16_t rhs)
+{
+  if (mapped) {
+    *mapped = rhs;
+  } else {
+    mem.before_write(address);
+    if (mem.code[address] && value != rhs) {
+      value = rhs;
+      mem.code_written(address);
+    } else {
+      value = rhs;
+    }
+  }
+
+  return *this;
+}
+
+inline Word Memory::operator[](uint16_t index)
+{
+  return Word(*this, index);
+}
+
+// Plain read, for the instruction fetch
+inline int16_t Memory::read(uint16_t index)
+{
+  if (is_device_page(index)) {
+    MappedWord *word = mapped_word(index);
+    if (word) {
+      return *word;
+    }
+  }
+  return mem[index];
+}
+
 #endif
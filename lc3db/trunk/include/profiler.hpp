@@ -0,0 +1,81 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#ifndef _PROFILER_HPP
+#define _PROFILER_HPP
+
+#include <stdio.h>
+#include <vector>
+#include <map>
+#include <utility>
+#include <stdint.h>
+
+#include "source_info.hpp"
+#include "call_stack.hpp"
+
+// Exact instruction profile: the executions of every address, counted in
+// a flat array, and the calls with the instructions executed inside them,
+// as unwound from the CallStack.  The counts are attributed to the
+// functions and source lines only when a report is written.
+class Profiler : public CallStack::Listener
+{
+public:
+  Profiler();
+
+  void reset();
+
+  // Before executing the instruction at pc
+  void executed(uint16_t pc) {
+    counts[pc]++;
+    ticks++;
+  }
+
+  // Instructions profiled since the Profiler was created, which time the
+  // frames of the CallStack (not reset, the frames outlive a reset)
+  uint64_t clock() const { return ticks; }
+  // A frame of the CallStack returned at clock() count
+  void returned(const CallStack::Frame &frame, uint64_t count);
+
+  uint64_t instructions() const { return ticks - since; }
+
+  // The COUNT hottest functions and source lines, with the calls still
+  // running
+  void report(SourceInfo &src_info, const CallStack &running, FILE *out, int count);
+  // Profile for KCachegrind
+  bool write_callgrind(SourceInfo &src_info, const CallStack &running, const char *file_name);
+
+  struct Calls
+  {
+    uint64_t count;
+    uint64_t inclusive;	// instructions executed by the calls
+    Calls() : count(0), inclusive(0) { }
+  };
+  typedef std::map<std::pair<uint16_t, uint16_t>, Calls> calls_t;	// (site, target)
+
+private:
+  void add_call(const CallStack::Frame &frame, uint64_t count, calls_t &to) const;
+  calls_t all_calls(const CallStack &running) const;
+
+  std::vector<uint64_t> counts;
+  uint64_t ticks;
+  uint64_t since;	// clock() at the reset
+  calls_t calls;
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+
+#ifndef _RUN_THREAD_HPP
+#define _RUN_THREAD_HPP
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "cpu.hpp"
+
+// Thread simulating the machine of a debugging session.  The debugger
+// thread gives it the execution commands as jobs, and talks to a running
+// job through a mailbox of request bits, which can be posted from any
+// thread or signal handler without locking.  The job looks at the mailbox
+// and publishes the registers once per chunk of instructions, so they can
+// be shown while it runs.
+class RunThread
+{
+public:
+  enum { INTERRUPT = 1 };	// requests
+  enum { CHUNK = 1024 };	// instructions between the mailbox checks
+
+  // Registers published by the job
+  struct Status
+  {
+    uint16_t PC;
+    uint16_t PSR;
+    int16_t R[8];
+    int instructions;
+  };
+
+  RunThread();
+  // Interrupts the job, if any, and ends the thread
+  ~RunThread();
+
+  // Runs job(arg) on the thread, the previous job must have returned
+  void start(void (*job)(void *), void *arg);
+  bool busy() const { return running; }
+  // Blocks until the job returns
+  void wait();
+
+  void post(unsigned request) {
+    __sync_fetch_and_or(&requests, request);
+  }
+  // The requests posted since the last take(), which clears them
+  unsigned take() {
+    return requests ? __sync_fetch_and_and(&requests, 0) : 0;
+  }
+
+  void publish(const LC3::CPU &cpu, int instructions);
+  Status status() const;
+
+private:
+  RunThread(const RunThread &);
+
+  static void *run(void *arg);
+
+  volatile unsigned requests;
+
+  // seqlock of the status: odd while it is written
+  volatile unsigned sequence;
+  Status published;
+
+  pthread_t thread;
+  bool started;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  void (*job)(void *);
+  void *job_arg;
+  volatile bool running;
+  bool quit;
+};
+
+#endif
@@ -46,6 +46,7 @@ struct SourceLocation
 struct _SourceLocation;
 struct _HLLSourceLocation;
 struct _MachineSourceLocation;
+class DebugInfoFile;
 
 enum VariableKind {
 	FileGlobal,
@@ -143,6 +144,7 @@ public:
   ~SourceInfo();
 
   void reset_HLL_info(void);
+  void add_deferred_lines(DebugInfoFile *file);
   int add_source_file(int fileId, std::string filePath);
   void add_source_line(uint16_t firstAddress, uint16_t lastAddress, int fileId, int lineNo);
   void add_type(int typeId, const char* typeDescriptor);
@@ -155,6 +157,13 @@ public:
   SourceLocation find_source_location_short(uint16_t address);
   SourceLocation find_source_location_absolute(uint16_t address);
   uint16_t find_line_start_address(std::string fileName, int lineNo);
+  // Every C and assembly source line with its addresses (full paths)
+  std::vector<SourceLocation> source_lines();
+  // Precomputes the address lookups, done after loading a program (and
+  // by the first lookup after any change)
+  void index_addresses();
+  // Echo the declarations to stderr while they are added
+  bool verbose;
   std::map<std::string, uint16_t> symbol;
   
   // Todo: FixMe: Handle FileStatic variables per each source file
@@ -165,12 +174,25 @@ public:
 
 private:
   _SourceLocation find_source_location(uint16_t address); 
+  void load_deferred_lines();
   std::map<uint16_t, _MachineSourceLocation> machineSources; // lc3 address => source file location
   std::map<uint16_t, _HLLSourceLocation> HLLSources;         // lc3 address => source file location
   std::map<uint16_t, uint16_t> internalIds;    // userFileId => internalFileId
   std::vector<std::string> fileNames;	// internalFileID => short file name
   std::vector<std::string> filePaths;	// internalFileID => full path
   std::vector<std::vector<uint16_t> > startAddresses; // source file location => lc3 address (addresses[fileId][lineNo])
+
+  struct DeferredLines
+  {
+    DebugInfoFile *file;
+    bool HLL;	// the C lines are still wanted (not reset since)
+  };
+  std::vector<DeferredLines> deferredLines;	// lines of mapped files not added yet
+
+  bool addressesIndexed;	// the tables below are up to date
+  std::vector<_SourceLocation> lineRecords;	// [0] is the location of no source
+  std::vector<uint32_t> lineIndex;	// lc3 address => lineRecords index
+  std::vector<SourceBlock*> blockIndex;	// lc3 address => innermost source block
 };
 
 
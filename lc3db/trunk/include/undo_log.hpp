@@ -0,0 +1,133 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#ifndef _UNDO_LOG_HPP
+#define _UNDO_LOG_HPP
+
+#include <vector>
+#include <stdint.h>
+
+#include "memory.hpp"
+#include "cpu.hpp"
+
+// Bounded log of the changes made by the executed instructions, undone
+// by the reverse execution commands.  Every step records the old PC, the
+// old value of the registers it changed, the old words of the memory it
+// wrote and the addresses it read (for the read watchpoints).  When the
+// log is full the oldest steps are dropped.
+//
+// The devices are not rewound: the writes to the device registers are not
+// recorded and the keys read stay read.
+class UndoLog
+{
+public:
+  enum { MAX_WRITES = 15, MAX_READS = 15 };
+
+  // What undo() took back
+  struct Step
+  {
+    bool interrupt;	// the step was an interrupt, not an instruction
+    int writes;
+    uint16_t address[MAX_WRITES];
+    int reads;
+    uint16_t read_address[MAX_READS];
+  };
+
+  UndoLog(size_t max_bytes);
+
+  // Recording of a step: begin(), the writes, end()
+  void begin(const LC3::CPU &cpu) {
+    if (!buf.empty()) {
+      before = Registers(cpu);
+      writes = reads = 0;
+      recording = true;
+    }
+  }
+  void write(uint16_t address, int16_t old_value) {
+    if (recording && writes < MAX_WRITES) {
+      pending[writes][0] = address;
+      pending[writes][1] = old_value;
+      writes++;
+    }
+  }
+  void read(uint16_t address) {
+    if (recording && reads < MAX_READS) {
+      read_addresses[reads++] = address;
+    }
+  }
+  void end(const LC3::CPU &cpu, bool interrupt = false) {
+    if (recording) {
+      push(cpu, interrupt);
+    }
+  }
+
+  bool undo(LC3::CPU &cpu, Memory &mem, Step &step);
+  bool empty() const { return used == 0; }
+  // PC the next undo() goes back to, the log must not be empty
+  uint16_t last_pc() const;
+  bool last_is_interrupt() const;
+
+  void clear();
+  // Drops the log, 0 disables the recording
+  void set_limit(size_t max_bytes);
+  size_t limit() const { return buf.size() * sizeof(uint16_t); }
+  size_t steps() const { return count; }
+
+private:
+  struct Registers
+  {
+    Registers() { }
+    Registers(const LC3::CPU &cpu);
+    uint16_t reg[12];	// PC, PSR, R0-R7, USP, SSP
+  };
+
+  // header of a step: the bits of the changed registers (but the PC, which
+  // is always saved), the flag of the memory accesses and the interrupt
+  // flag.  With ACCESSES the header is followed (and preceded at the end)
+  // by the count of writes and, in the high byte, of reads.
+  enum { REG_MASK = 0x07FF, ACCESSES = 0x0800, INTERRUPT = 0x8000, READS_SHIFT = 8 };
+  static int length(uint16_t header, uint16_t accesses);
+  // Length of the step whose header is at p, or ends at p if backward
+  int length_at(size_t p, bool backward) const;
+
+  void push(const LC3::CPU &cpu, bool interrupt);
+  void put(uint16_t word) {
+    buf[head] = word;
+    head = (head + 1 == buf.size()) ? 0 : head + 1;
+  }
+  size_t position(size_t from, int offset) const {
+    return (from + offset + buf.size()) % buf.size();
+  }
+  void drop_oldest();
+
+  std::vector<uint16_t> buf;	// ring of the steps, oldest at tail
+  size_t head;
+  size_t tail;
+  size_t used;			// words
+  size_t count;			// steps
+
+  bool recording;
+  Registers before;
+  int writes;
+  uint16_t pending[MAX_WRITES][2];
+  int reads;
+  uint16_t read_addresses[MAX_READS];
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#ifndef _WATCH_RANGES_HPP
+#define _WATCH_RANGES_HPP
+
+#include <map>
+#include <algorithm>
+#include <stdint.h>
+
+// Watched addresses of one kind, as disjoint intervals.  The accesses to
+// the pages without any watched address skip the lookup.
+class WatchRanges
+{
+public:
+  WatchRanges() {
+    for (int p=0; p < 0x100; p++) {
+      pages[p] = false;
+    }
+  }
+
+  bool empty() const {
+    return ranges.empty();
+  }
+
+  bool contains(uint16_t addr) const {
+    return pages[addr >> 8] && lookup(addr);
+  }
+
+  void add(uint16_t first, uint16_t last) {
+    int from = first, to = last;
+    // merge the overlapping and adjacent intervals
+    range_map_t::iterator i = ranges.upper_bound(first);
+    if (i != ranges.begin() && (int)(--i)->second + 1 < from) {
+      ++i;
+    }
+    while (i != ranges.end() && (int)i->first <= to + 1) {
+      from = std::min(from, (int)i->first);
+      to = std::max(to, (int)i->second);
+      ranges.erase(i++);
+    }
+    ranges[from] = to;
+    update_pages();
+  }
+
+  void remove(uint16_t first, uint16_t last) {
+    range_map_t::iterator i = ranges.upper_bound(first);
+    if (i != ranges.begin() && (--i)->second < first) {
+      ++i;
+    }
+    while (i != ranges.end() && i->first <= last) {
+      uint16_t from = i->first, to = i->second;
+      ranges.erase(i++);
+      if (from < first) {
+	ranges[from] = first - 1;
+      }
+      if (to > last) {
+	ranges[last + 1] = to;
+      }
+    }
+    update_pages();
+  }
+
+private:
+  typedef std::map<uint16_t, uint16_t> range_map_t;	// first -> last
+
+  bool lookup(uint16_t addr) const {
+    range_map_t::const_iterator i = ranges.upper_bound(addr);
+    return i != ranges.begin() && addr <= (--i)->second;
+  }
+
+  void update_pages() {
+    for (int p=0; p < 0x100; p++) {
+      pages[p] = false;
+    }
+    for (range_map_t::iterator i = ranges.begin(); i != ranges.end(); ++i) {
+      for (int p = i->first >> 8; p <= i->second >> 8; p++) {
+	pages[p] = true;
+      }
+    }
+  }
+
+  range_map_t ranges;
+  bool pages[0x100];
+};
+
+// Watchpoints of the GDB remote protocol, checked by mem_read() and
+// mem_write() when there is no debugger session (see set_data_watch()).
+// The first watched access is kept until the run stops.
+struct DataWatch
+{
+  WatchRanges write, read, access;
+  const char *hit;	// "watch", "rwatch" or "awatch", NULL if none
+  uint16_t address;
+
+  DataWatch() : hit(NULL), address(0) { }
+
+  bool empty() const {
+    return write.empty() && read.empty() && access.empty();
+  }
+
+  void accessed(uint16_t addr, bool written) {
+    if (hit) {
+      return;
+    }
+    if (written && write.contains(addr)) {
+      hit = "watch";
+    } else if (!written && read.contains(addr)) {
+      hit = "rwatch";
+    } else if (access.contains(addr)) {
+      hit = "awatch";
+    } else {
+      return;
+    }
+    address = addr;
+  }
+};
+
+#endif
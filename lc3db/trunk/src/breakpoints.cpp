@@ -32,11 +32,16 @@ struct Breakpoint
   int hits;
   std::string file;
   int line;
+  Expression *expression;	// condition of a breakpoint, watched by a watchpoint
+  int16_t old_value;		// of the watched expression
+  long frame_depth;		// of the locals watched, -1 if none
 
   Breakpoint(int _id, uint16_t _address, std::string _file, int _line) :
     id(_id), address(_address), file(_file), line(_line),
     kind(bkBreakpoint),
-    disposition(Keep), enabled(true), ignore_count(0), hits(0) {}
+    disposition(Keep), enabled(true), ignore_count(0), hits(0),
+    expression(NULL), old_value(0), frame_depth(-1) {}
+  ~Breakpoint() { delete expression; }
 };	
 
 //////////////////////////////////////////////////////////
@@ -87,7 +92,7 @@ public:
       printf("No breakpoints or watchpoints.\n");
     }
   }
-  static void list_line(int id, uint16_t address, BreakpointDisposition disp, bool enabled, int hits, int ignore, const char *file, int line){
+  static void list_line(int id, uint16_t address, BreakpointDisposition disp, bool enabled, int hits, int ignore, const char *file, int line, const char *condition){
     const char * dispStr = "keep";
     if (disp == Delete) {
       dispStr = "del";
@@ -104,11 +109,40 @@ public:
 	     //   "Num", "Type", "Disp", "Enb", "Address", "What",
 	     id, "breakpoint", dispStr, enabled ? "y" : "n", address);
     }
+    if (condition) printf("\tstop only if %s\n", condition);
+    if (hits) printf("\t	breakpoint already hit %d times\n", hits);
+    if (ignore) printf("\t	ignore next %d hits\n", ignore);
+  }
+  //	3       watchpoint     keep y              count * 2
+  static void list_watch(int id, bool enabled, int hits, int ignore, const char *expression){
+    printf("%-8d%-15s%-5s%-4s%-11s%s\n",
+	   id, "watchpoint", "keep", enabled ? "y" : "n", "", expression);
     if (hits) printf("\t	breakpoint already hit %d times\n", hits);
     if (ignore) printf("\t	ignore next %d hits\n", ignore);
   }
   static void list_line(Breakpoint *b){
-    list_line(b->id, b->address, b->disposition, b->enabled, b->hits, b->ignore_count, b->file.c_str(), b->line);
+    if (b->kind != bkBreakpoint && b->expression) {
+      list_watch(b->id, b->enabled, b->hits, b->ignore_count, b->expression->text().c_str());
+      return;
+    }
+    list_line(b->id, b->address, b->disposition, b->enabled, b->hits, b->ignore_count, b->file.c_str(), b->line,
+	      b->expression ? b->expression->text().c_str() : NULL);
+  }
+
+  // Watched expression changed:
+  //
+  //   Watchpoint 2: count
+  //
+  //   Old value = 1
+  //   New value = 2
+  static void value_changed(int id, const char *expression, int16_t old_value, int16_t new_value){
+    printf("\nWatchpoint %d: %s\n\nOld value = %d\nNew value = %d\n",
+	   id, expression, old_value, new_value);
+  }
+  // Watch of the locals of a frame returned
+  static void out_of_scope(int id){
+    printf("\nWatchpoint %d deleted because the program has left the block in\n"
+	   "which its expression is valid.\n", id);
   }
 
   // Set Ignore Count
@@ -120,15 +154,24 @@ public:
   static void no_breakpoint(int id){
     printf("No breakpoint number %d.\n", id);
   }
-  // Duplicates not allowed
+  // Duplicates:
+  //   Note: breakpoint 2 also set at pc 0x3000.
   static void duplicate(uint16_t address, int id){
-    printf("Preakpoint for address 0x%04x already defined, see breakpoint %d.\n", address, id);
+    printf("Note: breakpoint %d also set at pc 0x%04x.\n", id, address);
   }
 };
 
 
 //////////////////////////////////////////////////////////
 // UserBreakpoits class
+UserBreakpoits::UserBreakpoits(SourceInfo &_src_info) :
+  src_info(_src_info), last_id(0), active_count(0)
+{
+  for (int i=0; i < 0x10000 / 32; i++) {
+    active[i] = 0;
+  }
+}
+
 int UserBreakpoits::addWatch(uint16_t address, bool temp, BreakpointKind kind)
 { 
   /*   Might avoid duplicate later 
@@ -158,12 +201,26 @@ int UserBreakpoits::addWatch(uint16_t address, bool temp, BreakpointKind kind)
   return last_id;
 }
 
-int UserBreakpoits::add(uint16_t address, bool temp)
+int UserBreakpoits::addWatch(Expression *expression, size_t depth)
+{
+  Breakpoint* b = new Breakpoint(++last_id, 0, "", -1);
+  b->kind = bkWatchpoint;
+  b->expression = expression;
+  b->old_value = expression->value();
+  if (expression->frame_relative()) {
+    b->frame_depth = depth;
+  }
+  breakpoints.push_back(b);
+  update_watches();
+
+  return last_id;
+}
+
+int UserBreakpoits::add(uint16_t address, bool temp, Expression *condition)
 { 
-  BreakpointIterator it = lookupA(address);
-  if (it != breakpoints.end()) {
-    BreakpointsUI::duplicate(address, (*it)->id);
-    return -1;
+  int other = find(address);
+  if (other) {
+    BreakpointsUI::duplicate(address, other);
   }
 
   SourceLocation sl = src_info.find_source_location_short(address);
@@ -172,20 +229,62 @@ int UserBreakpoits::add(uint16_t address, bool temp)
   if (temp) {
     b->disposition = Delete;
   }
+  b->expression = condition;
   breakpoints.push_back(b);
-  active_breakpoints.insert(address);
+  by_address.insert(std::make_pair(address, b));
+  update_active(address);
   //BreakpointsUI::creation(last_id, address, temp, sl.fileName, sl.lineNo);
 
   return last_id;
 }
 
+int UserBreakpoits::find(uint16_t address)
+{
+  address_map_t::iterator i = by_address.find(address);
+  return i == by_address.end() ? 0 : i->second->id;
+}
+
+void UserBreakpoits::update_active(uint16_t address)
+{
+  bool enabled = false;
+  std::pair<address_map_t::iterator, address_map_t::iterator> range =
+    by_address.equal_range(address);
+
+  for (address_map_t::iterator i = range.first; i != range.second; ++i) {
+    enabled = enabled || i->second->enabled;
+  }
+  uint32_t bit = 1u << (address & 31);
+  if (enabled && !(active[address >> 5] & bit)) {
+    active[address >> 5] |= bit;
+    active_count++;
+  } else if (!enabled && (active[address >> 5] & bit)) {
+    active[address >> 5] &= ~bit;
+    active_count--;
+  }
+}
 
 int UserBreakpoits::erase(BreakpointIterator it)
 {
-  active_breakpoints.erase((*it)->address);
+  Breakpoint *b = *it;
+  int id = b->id;
+
   breakpoints.erase(it);
-  int id = (*it)->id;
-  delete *it;
+  if (b->kind == bkBreakpoint) {
+    std::pair<address_map_t::iterator, address_map_t::iterator> range =
+      by_address.equal_range(b->address);
+    for (address_map_t::iterator i = range.first; i != range.second; ++i) {
+      if (i->second == b) {
+	by_address.erase(i);
+	break;
+      }
+    }
+    update_active(b->address);
+  }
+  if (b->enabled) {
+    b->enabled = false;
+    update_watches();
+  }
+  delete b;
 
   return id;
 }
@@ -203,12 +302,15 @@ int UserBreakpoits::erase(int id)
 
 int UserBreakpoits::setEnabled(BreakpointIterator it, bool enable, bool setDisp, BreakpointDisposition disp)
 {
-  if (enable) {
-    active_breakpoints.insert((*it)->address);
-  } else {
-    active_breakpoints.erase((*it)->address);
-  }
   (*it)->enabled = enable;
+  if ((*it)->kind == bkBreakpoint) {
+    update_active((*it)->address);
+  } else if ((*it)->expression) {
+    if (enable) {
+      (*it)->old_value = (*it)->expression->value();
+    }
+    update_watches();
+  }
 
   if (setDisp)
     (*it)->disposition = disp;
@@ -241,51 +343,104 @@ int UserBreakpoits::setIgnoreCount(int id, int count)
   return id;
 }
 
-int UserBreakpoits::check(uint16_t address)
+// All the enabled breakpoints at the address are hit, the first one not
+// ignored stops the execution
+int UserBreakpoits::hit(uint16_t address)
 {
-  // This must be efficient (used each cycle).
-  // First make a quick check
-  if (active_breakpoints.count(address)) {
-    // there sould be a breakpoint, look it up
-    BreakpointIterator it;
+  std::pair<address_map_t::iterator, address_map_t::iterator> range =
+    by_address.equal_range(address);
+  std::list<Breakpoint*> hit;
+  int id = 0;
+
+  for (address_map_t::iterator i = range.first; i != range.second; ++i) {
+    Breakpoint *b = i->second;
+    if (b->enabled && (!b->expression || b->expression->value())) {
+      hit.push_back(b);
+    }
+  }
 
-    for (it = breakpoints.begin();
-	 it != breakpoints.end();
-	 it++) {
-      if ((*it)->address == address &&
-	  (*it)->enabled) {
-	// return here: Only single breakpoint per address supported (if more are needed active_breakpoints has to be more complicated)
-	Breakpoint *b = *it;
-	bool temporary = false;
-
-	b->hits++;
-	if (b->ignore_count) {
-	  b->ignore_count--;
-	  return 0;
-	} else {
-	  switch (b->disposition) { 
-	  case Keep:
-	    // Fine
-	    break;
-	  case Disable:
-	    this->setEnabled(it, false, true, Disable);
-	    break;
-	  case Delete:
-	    temporary = true;
-	    break;
-	  default:
-	    fprintf(stderr, "internal inconsistency: Unknown disposition");
-	  }
-	  BreakpointsUI::hit(b->id, b->address, temporary, b->file.c_str(), b->line);
-	  if (temporary) 
-	    this->erase(it);
-	  return b->id;
+  for (std::list<Breakpoint*>::iterator h = hit.begin(); h != hit.end(); ++h) {
+    Breakpoint *b = *h;
+    bool temporary = false;
+
+    b->hits++;
+    if (b->ignore_count) {
+      b->ignore_count--;
+      continue;
+    }
+    switch (b->disposition) { 
+    case Keep:
+      // Fine
+      break;
+    case Disable:
+      this->setEnabled(lookupI(b->id), false, true, Disable);
+      break;
+    case Delete:
+      temporary = true;
+      break;
+    default:
+      fprintf(stderr, "internal inconsistency: Unknown disposition");
+    }
+    BreakpointsUI::hit(b->id, b->address, temporary, b->file.c_str(), b->line);
+    if (!id) {
+      id = b->id;
+    }
+    if (temporary) 
+      this->erase(lookupI(b->id));
+  }
+
+  return id;
+}
+
+void UserBreakpoits::update_watches()
+{
+  value_watches.clear();
+  for (BreakpointIterator it = breakpoints.begin(); it != breakpoints.end(); it++) {
+    if ((*it)->kind != bkBreakpoint && (*it)->expression && (*it)->enabled) {
+      value_watches.push_back(*it);
+    }
+  }
+}
+
+int UserBreakpoits::checkWatches(size_t depth)
+{
+  int id = 0;
+  std::vector<int> left;
+
+  for (size_t i=0; i < value_watches.size(); i++) {
+    Breakpoint *b = value_watches[i];
+    if (b->frame_depth >= 0 && depth != (size_t)b->frame_depth) {
+      // R5 is the frame pointer of a callee, or of a caller once returned
+      if (depth < (size_t)b->frame_depth) {
+	BreakpointsUI::out_of_scope(b->id);
+	left.push_back(b->id);
+	if (!id) {
+	  id = b->id;
 	}
       }
+      continue;
+    }
+    int16_t value = b->expression->value();
+    if (value == b->old_value) {
+      continue;
+    }
+    int16_t old_value = b->old_value;
+    b->old_value = value;
+    b->hits++;
+    if (b->ignore_count) {
+      b->ignore_count--;
+      continue;
     }
+    BreakpointsUI::value_changed(b->id, b->expression->text().c_str(), old_value, value);
+    if (!id) {
+      id = b->id;
+    }
+  }
+  for (size_t i=0; i < left.size(); i++) {
+    erase(left[i]);
   }
 
-  return 0;
+  return id;
 }
 
 void UserBreakpoits::showInfo()
@@ -301,21 +456,6 @@ void UserBreakpoits::showInfo()
   }
 }
 
-BreakpointIterator UserBreakpoits::lookupA(uint16_t address)
-{
-    BreakpointIterator it;
-
-    for (it = breakpoints.begin();
-	 it != breakpoints.end();
-	 it++) {
-      if ((*it)->address == address) {
-	return it;
-      }
-    }
-    
-    return breakpoints.end();
-}
-
 BreakpointIterator UserBreakpoits::lookupI(int id)
 {
     BreakpointIterator it;
@@ -0,0 +1,55 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#include "checkpoint.hpp"
+
+Checkpoint::Checkpoint(LC3::CPU &cpu, Memory &mem, Hardware &hw) :
+  cpu(cpu), mem(mem), hw(hw), PC(cpu.PC), PSR(cpu.PSR), USP(cpu.USP), SSP(cpu.SSP),
+  depth(cpu.depth)
+{
+  for (int i=0; i < 8; i++) {
+    R[i] = cpu.R[i];
+  }
+  hw.save(hw_state);
+  snapshot = mem.snapshot();
+}
+
+Checkpoint::~Checkpoint()
+{
+  delete snapshot;
+}
+
+void Checkpoint::restore()
+{
+  // the memory brings back the device events, the devices then their
+  // registers
+  mem.restore(snapshot);
+  hw.restore(hw_state);
+
+  cpu.PC = PC;
+  cpu.PSR = PSR;
+  for (int i=0; i < 8; i++) {
+    cpu.R[i] = R[i];
+  }
+  cpu.USP = USP;
+  cpu.SSP = SSP;
+  cpu.depth = depth;
+}
+
+// vim: sw=2 si:
@@ -0,0 +1,198 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <algorithm>
+#include "coverage.hpp"
+
+void Coverage::reset()
+{
+  std::fill(flags.begin(), flags.end(), 0);
+}
+
+// BR with some, but not all, of the n, z and p conditions
+static bool is_conditional_branch(uint16_t IR)
+{
+  uint16_t nzp = (IR >> 9) & 7;
+  return (IR & 0xF000) == 0x0000 && nzp != 0 && nzp != 7;
+}
+
+void CoverageReport::add_branch(int64_t &total, int64_t count)
+{
+  if (total == NOT_EXECUTED) {
+    total = count;
+  } else if (count != NOT_EXECUTED) {
+    total += count;
+  }
+}
+
+void CoverageReport::add(const Coverage &coverage, SourceInfo &src_info, Memory &mem)
+{
+  typedef std::pair<std::string, int> line_t;	// (file, line)
+  std::map<line_t, bool> covered;
+  std::map<line_t, std::set<uint16_t> > branches;
+
+  // A C line may have several address ranges, the line is covered when
+  // any of its instructions is executed
+  std::vector<SourceLocation> lines = src_info.source_lines();
+  for (size_t i = 0; i < lines.size(); i++) {
+    line_t line(lines[i].fileName, lines[i].lineNo);
+    bool &executed = covered[line];
+    for (int addr = lines[i].firstAddr; addr <= lines[i].lastAddr; addr++) {
+      executed = executed || coverage.was_executed(addr);
+      if (is_conditional_branch(mem.read(addr))) {
+	branches[line].insert(addr);
+      }
+    }
+  }
+
+  for (std::map<line_t, bool>::const_iterator l = covered.begin(); l != covered.end(); ++l) {
+    files[l->first.first].lines[l->first.second] += l->second;
+  }
+  for (std::map<line_t, std::set<uint16_t> >::const_iterator l = branches.begin();
+       l != branches.end(); ++l) {
+    File &file = files[l->first.first];
+    int block = 0;
+    for (std::set<uint16_t>::const_iterator addr = l->second.begin();
+	 addr != l->second.end(); ++addr, ++block) {
+      Branch &branch = file.branches[std::make_pair(l->first.second, block)];
+      if (coverage.was_executed(*addr)) {
+	add_branch(branch.taken, coverage.jumped(*addr));
+	add_branch(branch.not_taken, coverage.fell_through(*addr));
+      }
+    }
+  }
+
+  // The C functions, a function is called when its entry is executed
+  std::set<FunctionInfo*> functions;
+  for (std::map<uint16_t, SourceBlock*>::const_iterator b = src_info.sourceBlocks.begin();
+       b != src_info.sourceBlocks.end(); ++b) {
+    if (b->second->function) {
+      functions.insert(b->second->function);
+    }
+  }
+  for (std::set<FunctionInfo*>::const_iterator f = functions.begin(); f != functions.end(); ++f) {
+    SourceLocation loc = src_info.find_source_location_absolute((*f)->entry);
+    if (loc.lineNo > 0) {
+      std::pair<int, uint64_t> &function = files[loc.fileName].functions[(*f)->name];
+      function.first = loc.lineNo;
+      function.second += coverage.was_executed((*f)->entry);
+    }
+  }
+}
+
+bool CoverageReport::read(const char *file_name)
+{
+  FILE *in = fopen(file_name, "r");
+  char buf[4096];
+  File *file = NULL;
+
+  if (!in) {
+    return false;
+  }
+  while (fgets(buf, sizeof(buf), in)) {
+    buf[strcspn(buf, "\r\n")] = 0;
+    int line, block, branch;
+    unsigned long long count;
+    char taken[32];
+    char *name = strchr(buf, ',');
+
+    if (strncmp(buf, "SF:", 3) == 0) {
+      file = &files[buf + 3];
+    } else if (strcmp(buf, "end_of_record") == 0) {
+      file = NULL;
+    } else if (!file) {
+      continue;
+    } else if (2 == sscanf(buf, "DA:%d,%llu", &line, &count)) {
+      file->lines[line] += count;
+    } else if (name && 1 == sscanf(buf, "FN:%d,", &line)) {
+      file->functions[name + 1].first = line;
+    } else if (name && 1 == sscanf(buf, "FNDA:%llu,", &count)) {
+      file->functions[name + 1].second += count;
+    } else if (4 == sscanf(buf, "BRDA:%d,%d,%d,%31s", &line, &block, &branch, taken)) {
+      Branch &b = file->branches[std::make_pair(line, block)];
+      int64_t n = (taken[0] == '-') ? NOT_EXECUTED : atoll(taken);
+      if (branch == 0) {
+	add_branch(b.taken, n);
+      } else if (branch == 1) {
+	add_branch(b.not_taken, n);
+      }
+    }
+  }
+  fclose(in);
+  return true;
+}
+
+static void print_branch(FILE *out, int line, int block, int branch, int64_t count)
+{
+  if (count < 0) {
+    fprintf(out, "BRDA:%d,%d,%d,-\n", line, block, branch);
+  } else {
+    fprintf(out, "BRDA:%d,%d,%d,%lld\n", line, block, branch, (long long)count);
+  }
+}
+
+bool CoverageReport::write(const char *file_name, const char *test_name)
+{
+  FILE *out = fopen(file_name, "w");
+  if (!out) {
+    return false;
+  }
+
+  for (std::map<std::string, File>::const_iterator f = files.begin(); f != files.end(); ++f) {
+    const File &file = f->second;
+    int found = 0, hit = 0;
+
+    fprintf(out, "TN:%s\nSF:%s\n", test_name, f->first.c_str());
+
+    std::map<std::string, std::pair<int, uint64_t> >::const_iterator fn;
+    for (fn = file.functions.begin(); fn != file.functions.end(); ++fn) {
+      fprintf(out, "FN:%d,%s\n", fn->second.first, fn->first.c_str());
+    }
+    for (fn = file.functions.begin(); fn != file.functions.end(); ++fn) {
+      fprintf(out, "FNDA:%llu,%s\n", (unsigned long long)fn->second.second, fn->first.c_str());
+      hit += (fn->second.second != 0);
+    }
+    fprintf(out, "FNF:%d\nFNH:%d\n", (int)file.functions.size(), hit);
+
+    found = hit = 0;
+    for (std::map<std::pair<int, int>, Branch>::const_iterator b = file.branches.begin();
+	 b != file.branches.end(); ++b) {
+      print_branch(out, b->first.first, b->first.second, 0, b->second.taken);
+      print_branch(out, b->first.first, b->first.second, 1, b->second.not_taken);
+      found += 2;
+      hit += (b->second.taken > 0) + (b->second.not_taken > 0);
+    }
+    fprintf(out, "BRF:%d\nBRH:%d\n", found, hit);
+
+    found = hit = 0;
+    for (std::map<int, uint64_t>::const_iterator l = file.lines.begin(); l != file.lines.end(); ++l) {
+      fprintf(out, "DA:%d,%llu\n", l->first, (unsigned long long)l->second);
+      found++;
+      hit += (l->second != 0);
+    }
+    fprintf(out, "LF:%d\nLH:%d\nend_of_record\n", found, hit);
+  }
+
+  bool ok = !ferror(out);
+  return fclose(out) == 0 && ok;
+}
@@ -0,0 +1,206 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <map>
+#include "debug_info_file.hpp"
+#include "source_info.hpp"
+
+// Layout of lc3tools/dbgx.h, the numbers are big endian
+static const char MAGIC[8] = "LC3DBGX";
+enum {
+  VERSION = 1,
+  HEADER_SIZE = 16,	// magic, version, number of sections
+  SECTION_SIZE = 12,	// id, offset, size
+  FILE_SIZE = 8,
+  SYMBOL_SIZE = 8,
+  TYPE_SIZE = 8,
+  SCOPE_SIZE = 16,
+  LINE_SIZE = 12
+};
+
+static inline uint16_t get16(const unsigned char *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get32(const unsigned char *p)
+{
+  return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+DebugInfoFile::DebugInfoFile(const std::string &file_name) :
+  file_name(file_name), data(NULL), size(0)
+{
+  memset(sections, 0, sizeof(sections));
+  memset(section_sizes, 0, sizeof(section_sizes));
+
+  int fd = open(file_name.c_str(), O_RDONLY);
+  struct stat stats;
+  if (fd == -1) {
+    return;
+  }
+  if (fstat(fd, &stats) == -1 || stats.st_size < HEADER_SIZE) {
+    close(fd);
+    return;
+  }
+  void *mapped = mmap(NULL, stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return;
+  }
+  data = (unsigned char *)mapped;
+  size = stats.st_size;
+
+  uint32_t count = get32(data + 12);
+  bool valid = memcmp(data, MAGIC, sizeof(MAGIC)) == 0 &&
+	       get32(data + 8) == VERSION &&
+	       HEADER_SIZE + (uint64_t)count * SECTION_SIZE <= size;
+  for (uint32_t i = 0; valid && i < count; i++) {
+    const unsigned char *entry = data + HEADER_SIZE + i * SECTION_SIZE;
+    uint32_t id = get32(entry);
+    uint32_t offset = get32(entry + 4);
+    uint32_t length = get32(entry + 8);
+    valid = offset <= size && length <= size - offset;
+    if (valid && id >= 1 && id <= NUM_SECTIONS) {	// unknown sections are skipped
+      sections[id] = data + offset;
+      section_sizes[id] = length;
+    }
+  }
+  // with the last string terminated, any offset in the section is a string
+  valid = valid && (section_sizes[STRINGS] == 0 ||
+		    sections[STRINGS][section_sizes[STRINGS] - 1] == 0);
+  if (!valid) {
+    fprintf(stderr, "%s: not a valid debug information file\n", file_name.c_str());
+    munmap(data, size);
+    data = NULL;
+  }
+}
+
+DebugInfoFile::~DebugInfoFile()
+{
+  if (data) {
+    munmap(data, size);
+  }
+}
+
+const char *DebugInfoFile::string(uint32_t offset) const
+{
+  return offset < section_sizes[STRINGS] ? (const char *)sections[STRINGS] + offset : "";
+}
+
+bool DebugInfoFile::has_HLL_source() const
+{
+  for (size_t i = 0; i + FILE_SIZE <= section_sizes[FILES]; i += FILE_SIZE) {
+    if (get32(sections[FILES] + i) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void DebugInfoFile::load(SourceInfo &src_info)
+{
+  const unsigned char *p, *end;
+  bool verbose = src_info.verbose;
+
+  src_info.verbose = false;
+  src_info.reset_HLL_info();
+
+  end = sections[SYMBOLS] + section_sizes[SYMBOLS] / SYMBOL_SIZE * SYMBOL_SIZE;
+  for (p = sections[SYMBOLS]; p < end; p += SYMBOL_SIZE) {
+    src_info.symbol[string(get32(p + 4))] = get16(p);
+  }
+
+  end = sections[TYPES] + section_sizes[TYPES] / TYPE_SIZE * TYPE_SIZE;
+  for (p = sections[TYPES]; p < end; p += TYPE_SIZE) {
+    src_info.add_type(get32(p), string(get32(p + 4)));
+  }
+
+  // Same as the `B' and `S' lines of the text format, see load_prog()
+  end = sections[SCOPES] + section_sizes[SCOPES] / SCOPE_SIZE * SCOPE_SIZE;
+  for (p = sections[SCOPES]; p < end; p += SCOPE_SIZE) {
+    char kind = p[1];
+    uint16_t addr = get16(p + 2);
+    int number = (int32_t)get32(p + 4);
+    const char *name = string(get32(p + 8));
+    const char *info = string(get32(p + 12));
+
+    if (p[0] == 'B') {
+      if (kind == 'S') {
+	src_info.start_declaration_block(name, number, addr);
+      } else if (kind == 'E') {
+	src_info.finish_declaration_block(name, number, addr);
+      }
+    } else if (p[0] == 'S') {
+      switch (kind) {
+	case 'G':
+	case 'S':
+	case 's':
+	  src_info.add_absolute_variable((kind=='G') ? FileGlobal : (kind=='S') ? FileStatic : FunctionStatic,
+					 number, name, info);
+	  break;
+	case 'l':
+	case 'p':
+	  src_info.add_stack_variable((kind=='l') ? FunctionLocal : FunctionParameter,
+				      number, name, atoi(info));
+	  break;
+	case 'F':
+	case 'f':
+	  src_info.add_function(kind=='f', number, name, info);
+	  break;
+      }
+    }
+  }
+
+  src_info.verbose = verbose;
+  src_info.add_deferred_lines(this);
+}
+
+void DebugInfoFile::load_lines(SourceInfo &src_info, bool HLL) const
+{
+  size_t files = section_sizes[FILES] / FILE_SIZE;
+  std::map<uint32_t, uint16_t> registered;	// file id => its last DBGX_FILES record
+  const unsigned char *end = sections[LINES] + section_sizes[LINES] / LINE_SIZE * LINE_SIZE;
+
+  for (const unsigned char *p = sections[LINES]; p < end; p += LINE_SIZE) {
+    uint16_t file = get16(p);
+    if (file >= files) {
+      continue;
+    }
+    const unsigned char *record = sections[FILES] + file * FILE_SIZE;
+    uint32_t id = get32(record);
+    if (id != 0 && !HLL) {
+      continue;
+    }
+    std::map<uint32_t, uint16_t>::iterator r = registered.find(id);
+    if (r == registered.end() || r->second != file) {
+      src_info.add_source_file(id, string(get32(record + 4)));
+      registered[id] = file;
+    }
+    src_info.add_source_line(get16(p + 8), get16(p + 10), id, get32(p + 4));
+  }
+}
@@ -0,0 +1,340 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include "expression.hpp"
+
+struct bad_expression
+{
+  bad_expression(const std::string &_message) : message(_message) { }
+  std::string message;
+};
+
+// Recursive descent parser emitting the instructions, the operands are
+// kept in the registers as on a stack
+class ExpressionParser
+{
+public:
+  ExpressionParser(Expression &_expr, SourceInfo &_src_info, uint16_t _scope) :
+    expr(_expr), src_info(_src_info), scope(_scope), pos(0), top(0) { }
+
+  void parse() {
+    tokenize();
+    parse_binary(0);
+    if (pos != tokens.size()) {
+      throw bad_expression("A syntax error in expression, near `" + tokens[pos] + "'.");
+    }
+  }
+
+private:
+  typedef Expression E;
+
+  void tokenize() {
+    static const char *operators[] = {
+      "||", "&&", "==", "!=", "<=", ">=", "<<", ">>",
+      "|", "^", "&", "<", ">", "+", "-", "*", "/", "%", "!", "~", "(", ")", NULL
+    };
+    const std::string &s = expr.source;
+    size_t i = 0;
+
+    while (i < s.size()) {
+      if (isspace(s[i])) {
+	i++;
+	continue;
+      }
+      size_t start = i;
+      if (isalnum(s[i]) || s[i] == '_' || s[i] == '#' || s[i] == '.') {
+	i++;
+	while (i < s.size() && (isalnum(s[i]) || s[i] == '_' || s[i] == '.')) {
+	  i++;
+	}
+      } else {
+	for (const char **op = operators; *op; op++) {
+	  if (s.compare(i, strlen(*op), *op) == 0) {
+	    i += strlen(*op);
+	    break;
+	  }
+	}
+	if (i == start) {
+	  throw bad_expression(std::string("Invalid character '") + s[i] + "' in expression.");
+	}
+      }
+      tokens.push_back(s.substr(start, i - start));
+    }
+  }
+
+  bool accept(const char *token) {
+    if (pos < tokens.size() && tokens[pos] == token) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  int push() {
+    if (top == E::MAX_REGS) {
+      throw bad_expression("The expression is too complex.");
+    }
+    return top++;
+  }
+
+  void emit(E::Opcode op, int dst, int a, int b, int16_t imm) {
+    E::Instruction i;
+    i.op = op;
+    i.dst = dst;
+    i.a = a;
+    i.b = b;
+    i.imm = imm;
+    expr.code.push_back(i);
+  }
+
+  // Binary operators by precedence, lowest first
+  void parse_binary(int level) {
+    static const struct {
+      const char *token;
+      E::Opcode op;
+      int level;
+    } binary[] = {
+      { "||", E::LOR, 0 }, { "&&", E::LAND, 1 },
+      { "|", E::OR, 2 }, { "^", E::XOR, 3 }, { "&", E::AND, 4 },
+      { "==", E::EQ, 5 }, { "!=", E::NE, 5 },
+      { "<", E::LT, 6 }, { "<=", E::LE, 6 }, { ">", E::GT, 6 }, { ">=", E::GE, 6 },
+      { "<<", E::SHL, 7 }, { ">>", E::SHR, 7 },
+      { "+", E::ADD, 8 }, { "-", E::SUB, 8 },
+      { "*", E::MUL, 9 }, { "/", E::DIV, 9 }, { "%", E::MOD, 9 },
+      { NULL, E::CONST, 10 }
+    };
+
+    if (level == 10) {
+      parse_unary();
+      return;
+    }
+    parse_binary(level + 1);
+    for (;;) {
+      int i;
+      for (i = 0; binary[i].token; i++) {
+	if (binary[i].level == level && accept(binary[i].token)) {
+	  break;
+	}
+      }
+      if (!binary[i].token) {
+	return;
+      }
+      parse_binary(level + 1);
+      top--;
+      emit(binary[i].op, top - 1, top - 1, top, 0);
+    }
+  }
+
+  void parse_unary() {
+    if (accept("-")) {
+      parse_unary();
+      emit(E::NEG, top - 1, top - 1, 0, 0);
+    } else if (accept("+")) {
+      parse_unary();
+    } else if (accept("~")) {
+      parse_unary();
+      emit(E::NOT, top - 1, top - 1, 0, 0);
+    } else if (accept("!")) {
+      parse_unary();
+      emit(E::LNOT, top - 1, top - 1, 0, 0);
+    } else if (accept("*")) {
+      parse_unary();
+      emit(E::LOAD, top - 1, top - 1, 0, 0);
+    } else if (accept("&")) {
+      parse_name(true);
+    } else if (accept("(")) {
+      parse_binary(0);
+      if (!accept(")")) {
+	throw bad_expression("Missing `)' in expression.");
+      }
+    } else if (pos < tokens.size() && (isdigit(tokens[pos][0]) || tokens[pos][0] == '#')) {
+      emit(E::CONST, push(), 0, 0, number(tokens[pos++]));
+    } else {
+      parse_name(false);
+    }
+  }
+
+  static int16_t number(const std::string &token) {
+    const char *str = token.c_str();
+    int base = 0;
+    char *end;
+    if (str[0] == '#') {
+      str++;
+      base = 10;
+    } else if ((str[0] | 0x20) == 'x') {	// the lc3 hex (x1234)
+      str++;
+      base = 16;
+    }
+    long value = strtol(str, &end, base);
+    if (*end || end == str || value >= 0x10000 || value < -0x8000) {
+      throw bad_expression("Invalid number \"" + token + "\".");
+    }
+    return value & 0xFFFF;
+  }
+
+  static int register_index(const char *name) {
+    static const char *registers[] = {
+      "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "PC", "PSR", NULL
+    };
+    if (strncasecmp(name, "lc3CPU.", 7) == 0) {
+      name += 7;
+    }
+    for (int i = 0; registers[i]; i++) {
+      if (strcasecmp(name, registers[i]) == 0) {
+	return i;
+      }
+    }
+    return -1;
+  }
+
+  // Value (or address) of a variable, label or register
+  void parse_name(bool address) {
+    if (pos == tokens.size()) {
+      throw bad_expression("A syntax error in expression, near the end.");
+    }
+    const std::string &name = tokens[pos++];
+    int dst = push();
+
+    VariableInfo *v = src_info.find_variable(scope, name.c_str());
+    if (!v && src_info.globalVariables.count(name)) {
+      v = src_info.globalVariables[name];
+    }
+    if (v && !v->isCpuSpecial) {
+      if (v->isAddressAbsolute) {
+	emit(address ? E::CONST : E::LOAD_ABS, dst, 0, 0, v->address);
+      } else {
+	emit(address ? E::ADDR_FRAME : E::LOAD_FRAME, dst, 0, 0, v->address);
+      }
+      return;
+    }
+    if (src_info.symbol.count(name)) {
+      emit(address ? E::CONST : E::LOAD_ABS, dst, 0, 0, src_info.symbol[name]);
+      return;
+    }
+    if (strcasecmp(name.c_str(), "MCR") == 0 || strcasecmp(name.c_str(), "lc3CPU.MCR") == 0) {
+      emit(address ? E::CONST : E::LOAD_ABS, dst, 0, 0, 0xFFFE);
+      return;
+    }
+    int reg = register_index(name.c_str());
+    if (reg >= 0) {
+      if (address) {
+	throw bad_expression("Attempt to take address of value not located in memory.");
+      }
+      emit(E::REG, dst, 0, 0, reg);
+      return;
+    }
+    if (!address && (name[0] | 0x20) == 'x') {
+      try {
+	emit(E::CONST, dst, 0, 0, number(name));
+	return;
+      } catch (bad_expression &e) {
+      }
+    }
+    throw bad_expression("No symbol \"" + name + "\" in current context.");
+  }
+
+  Expression &expr;
+  SourceInfo &src_info;
+  uint16_t scope;
+  std::vector<std::string> tokens;
+  size_t pos;
+  int top;
+};
+
+Expression *Expression::compile(const std::string &text, SourceInfo &src_info,
+				uint16_t scope, LC3::CPU &cpu, Memory &mem)
+{
+  Expression *expr = new Expression(text, cpu, mem);
+  try {
+    ExpressionParser(*expr, src_info, scope).parse();
+  } catch (bad_expression &e) {
+    fprintf(stderr, "%s\n", e.message.c_str());
+    delete expr;
+    return NULL;
+  }
+  return expr;
+}
+
+bool Expression::frame_relative() const
+{
+  for (std::vector<Instruction>::const_iterator i = code.begin(); i != code.end(); ++i) {
+    if (i->op == LOAD_FRAME || i->op == ADDR_FRAME) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int16_t Expression::load(uint16_t address) const
+{
+  if (address != 0xFFFE && mem.is_mapped(address)) {	// MCR reads as is
+    return 0;
+  }
+  return mem[address];
+}
+
+int16_t Expression::value() const
+{
+  int16_t r[MAX_REGS] = { 0 };
+
+  for (std::vector<Instruction>::const_iterator i = code.begin(); i != code.end(); ++i) {
+    int a = r[i->a], b = r[i->b];
+    int16_t &dst = r[i->dst];
+    switch (i->op) {
+    case CONST:		dst = i->imm; break;
+    case REG:
+      dst = (i->imm < 8) ? cpu.R[i->imm] : (i->imm == 8) ? cpu.PC : cpu.PSR;
+      break;
+    case LOAD_ABS:	dst = load(i->imm); break;
+    case LOAD_FRAME:	dst = load(cpu.R[5] + i->imm); break;
+    case ADDR_FRAME:	dst = cpu.R[5] + i->imm; break;
+    case LOAD:		dst = load(a); break;
+    case NEG:		dst = -a; break;
+    case NOT:		dst = ~a; break;
+    case LNOT:		dst = !a; break;
+    case ADD:		dst = a + b; break;
+    case SUB:		dst = a - b; break;
+    case MUL:		dst = a * b; break;
+    case DIV:		dst = b ? a / b : 0; break;
+    case MOD:		dst = b ? a % b : 0; break;
+    case SHL:		dst = a << (b & 15); break;
+    case SHR:		dst = a >> (b & 15); break;
+    case AND:		dst = a & b; break;
+    case OR:		dst = a | b; break;
+    case XOR:		dst = a ^ b; break;
+    case EQ:		dst = a == b; break;
+    case NE:		dst = a != b; break;
+    case LT:		dst = a < b; break;
+    case LE:		dst = a <= b; break;
+    case GT:		dst = a > b; break;
+    case GE:		dst = a >= b; break;
+    case LAND:		dst = a && b; break;
+    case LOR:		dst = a || b; break;
+    }
+  }
+  return r[0];
+}
+
+// vim: sw=2 si:
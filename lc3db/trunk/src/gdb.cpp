@@ -28,6 +28,8 @@
 static char* readline (const char* prompt);
 #endif
 #include <set>
+#include <map>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
@@ -36,6 +38,7 @@ static char* readline (const char* prompt);
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include "cpu.hpp"
 #include "memory.hpp"
@@ -43,6 +46,14 @@ static char* readline (const char* prompt);
 #include "lexical_cast.hpp"
 #include "source_info.hpp"
 #include "breakpoints.hpp"
+#include "checkpoint.hpp"
+#include "undo_log.hpp"
+#include "expression.hpp"
+#include "watch_ranges.hpp"
+#include "profiler.hpp"
+#include "coverage.hpp"
+#include "call_stack.hpp"
+#include "run_thread.hpp"
 
 extern char* path_ptr;
 
@@ -75,27 +86,83 @@ struct FrameInfo {
   int id;
   uint16_t scope;
   uint16_t framePointer;
-  FunctionInfo *function;
+  FunctionInfo *function;	// NULL in assembly routines
+  char* name;
   char* sourceLocation;
-  FrameInfo(int _id, uint16_t _scope, uint16_t _framePointer, FunctionInfo* _function, const char* _sourceLocation):
-  	id(_id), scope(_scope), framePointer(_framePointer), function(_function), sourceLocation(strdup(_sourceLocation)) {}
-  ~FrameInfo() { free(sourceLocation); }
+  FrameInfo(int _id, uint16_t _scope, uint16_t _framePointer, FunctionInfo* _function, const char* _name, const char* _sourceLocation):
+  	id(_id), scope(_scope), framePointer(_framePointer), function(_function), name(strdup(_name)), sourceLocation(strdup(_sourceLocation)) {}
+  ~FrameInfo() { free(name); free(sourceLocation); }
 };
 
 struct BacktraceInfo {
-  uint16_t fromPC;
+  bool valid;	// built since the machine last changed
   std::vector<FrameInfo*> frames;
+  BacktraceInfo() : valid(false) { }
 };
 
-static BacktraceInfo backtrace;
-static std::vector<FrameInfo*>::iterator selected_frame=backtrace.frames.end();
-static int selected_frame_id = -1;
+// Memory cap of the reverse execution log turned on by `record'
+const size_t DEFAULT_UNDO_LOG_SIZE = 1024 * 1024;
+
+// State of one debugging session.  Each thread running gdb_mode() has its
+// own, so several simulated machines can live in one process.
+struct DebugSession {
+  BacktraceInfo backtrace;
+  std::vector<FrameInfo*>::iterator selected_frame;
+  int selected_frame_id;
+
+  //std::map<std::istring, int16_t *> cpu_special_variables;
+  std::map<const char*, int16_t *, str_case_cmp> cpu_special_variables;
+
+  int lastDisplay;
+  std::vector<DisplayInfo> displays;
+
+  // This is a quick and dirty implementation made in big hurry
+  FILE *traceout;  // enable to get the memory traces
+  WatchRanges w_watchpoints; // addresses for write watchpoints
+  WatchRanges r_watchpoints; // addresses for read watchpoints
+  bool watchpoint_was_hit;
+
+  // calls in progress, the backtrace is built from them
+  CallStack call_stack;
+
+  // machine states saved by the `save' command, and their call stacks
+  std::map<std::string, Checkpoint*> checkpoints;
+  std::map<std::string, CallStack> checkpoint_calls;
+
+  // steps executed, for the reverse execution
+  UndoLog undo_log;
+
+  // instruction counts of the `profile' command, kept after `profile off'
+  Profiler *profiler;
+  bool profiling;
+  // executed addresses of the `coverage' command, kept after `coverage off'
+  Coverage *coverage;
+  bool covering;
+
+  int instruction_count;
+  bool breakpoint_hit;	// Flag set once breakpoint is detected, so that breakpointed instruction can be enabled.
+
+  // simulates the machine, declared last to end before the rest
+  RunThread runner;
+
+  DebugSession() :
+    selected_frame(backtrace.frames.end()), selected_frame_id(-1),
+    lastDisplay(0), traceout(NULL), watchpoint_was_hit(false),
+    undo_log(0), profiler(NULL),
+    profiling(false), coverage(NULL), covering(false),
+    instruction_count(0), breakpoint_hit(false) { }
+  ~DebugSession() {
+    delete profiler;
+    delete coverage;
+    for (std::map<std::string, Checkpoint*>::iterator i = checkpoints.begin();
+	 i != checkpoints.end(); ++i) {
+      delete i->second;
+    }
+  }
+};
 
-//static std::map<std::istring, int16_t *> cpu_special_variables;
-static std::map<const char*, int16_t *, str_case_cmp> cpu_special_variables;
+static __thread DebugSession *session = NULL;
 
-static int lastDisplay = 0;
-static std::vector<DisplayInfo> displays;
 typedef std::vector<DisplayInfo>::reverse_iterator DisplayInfoIterator;
 const int DISPLAY_NOT_FOUND = -1;
 
@@ -113,6 +180,8 @@ const char * HELP_LIST =
 "  compile FILENAME.ASM         -- Assembles FILENAME.ASM\n"
 "  load|file FILENAME.OBJ       -- Loads the FILENAME.OBJ for debugging\n"
 "  tty TERMINAL                 -- Redirect the input/output of the debugged program to TERMINAL.\n"
+"  set output buffered|unbuffered -- Buffer the output of the debugged program until newline (default)\n"
+"  set traps native|os          -- Console TRAPs done by the simulator or by the routines of the OS (default)\n"
 "  quit|q|exit                  -- Quits the debugging session.\n"
 
 "\n=== Running ===\n"
@@ -120,11 +189,25 @@ const char * HELP_LIST =
 "  continue|cont|c              -- Continue execution after breakpoint\n"
 "  next|n                       -- Steps over the next source line (useful to step over the function calls)\n"
 "  nexti|ni                     -- Steps over the next instruction (useful to step over TRAP and JSR instructions)\n"
+"  until|u                      -- Like next, but doesn't stop when jumping back (to leave a loop)\n"
 "  step|s [COUNT]               -- Executes the next COUNT steps (line changes of the source).\n"
 "  stepi|si [COUNT]             -- Executes the next COUNT instruction.\n"
-"  finish                       -- Continue until return\n"
+"  finish                       -- Continue until the selected frame returns\n"
+"  interrupt                    -- Stop the program run in the background by `continue &' (or `run &', `next &'...)\n"
+"  reverse-stepi|rsi [COUNT]    -- Goes back COUNT instructions\n"
+"  reverse-next|rn              -- Goes back to the previous source line (stepping over the function calls)\n"
+"  reverse-continue|rc          -- Goes back untill the breakpoint is hit or the execution history ends\n"
+"  record|rec [stop]            -- Start (or stop) recording the execution history for the reverse execution\n"
+"  set record-size KBYTES       -- Memory used for the execution history (0 stops the recording)\n"
+"  save [NAME]                  -- Save the state of the machine\n"
+"  restore [NAME]               -- Go back to the saved state of the machine\n"
+"  profile on|off|reset         -- Count the executions of every instruction\n"
+"  info profile [COUNT]         -- Show the COUNT hottest functions and source lines\n"
+"  profile callgrind FILENAME   -- Write the profile for KCachegrind\n"
+"  coverage on|off|reset        -- Record the executed source lines and branches\n"
+"  coverage lcov FILENAME       -- Write the coverage for lcov/genhtml\n"
 "== Breakpoints ==\n"
-"  break|b|tbreak|tb LOCATION   -- Set breakpoint\n"
+"  break|b|tbreak|tb LOCATION [if EXPRESSION] -- Set breakpoint (stopping only if the EXPRESSION is not zero)\n"
 "  info breakpoints|b           -- Show breakpoints\n"
 "  ignore BREAKPOINT_ID COUNT   -- Ignore the breakpoint the next COUNT times\n"
 "  delete breakpoints BREAKPOINT_ID [BREAKPOINT_ID...]                 -- Delete the breakpoints\n"
@@ -132,6 +215,7 @@ const char * HELP_LIST =
 "  enable [breakpoints] [once|delete] BREAKPOINT_ID [BREAKPOINT_ID...] -- Enable the breakpoints\n"
 "== Watchpoint (stop execution on memory access) ==\n"
 "  watch [clear] FIRST_ADDR LAST_ADDR    -- Set/clear watchpoints on address write\n"
+"  watch EXPRESSION                      -- Stop when the value of the EXPRESSION changes\n"
 "  rwatch [clear] FIRST_ADDR LAST_ADDR   -- Set/clear watchpoints on address read\n"
 "  awatch [clear] FIRST_ADDR LAST_ADDR   -- Set/clear watchpoints on address read/write\n"
 "\n=== Examining the state of the program ===\n"
@@ -166,194 +250,18 @@ extern "C" {
   int lc3_asm(int, const char **);
 }
 
-uint16_t load_prog(const char *file, SourceInfo &src_info, Memory &mem, uint16_t *pEntry)
-{
-  char buf[4096];
-  const char *line_error = NULL;
-  int debugLine;
-  int linenum;
-  int fileId = -1;
-  int typeId = -1;
-  int addr, lastAddr;
-  int c;
-  FILE *f;
-  uint16_t ret;
-  const char *entryLabel = NULL;
-  std::string object = file;
-  std::string base = object.substr(0, object.rfind(".obj"));
-  std::string debug = base + ".dbg";
-
-  ret  = mem.load(object);
-  if (ret == 0xFFFF) return ret;
-
-  f = fopen(debug.c_str(), "rt");
-  if (!f) return ret;
-
-  /* Instead of introducing one more special directive to the assembler,
-   * assume that we have C program if fileID > 0 was encountered.
-   * See processing of '@' lines below.
-   *
-  if (1 == fscanf(f, "ENTRY:%s\n", buf)) {
-    entryLabel = strdup(buf);
-  } else {
-    fprintf(stderr, "ENTRY label missing (will break on first word)\n");
-  }
-  */
-
-  /* Discard all previous Higher Level Language source information.
-   * The assembly level information is word based, and will be overwritten
-   * individually, to allow loading of multiple source files.
-   */
-  src_info.reset_HLL_info();
-  fprintf(stderr, "\n--------------------- starting parsing debug file: %s -------------------------------\n", debug.c_str());
-
-
-  debugLine = 0;
-  while (!feof(f)) {
-    debugLine++;
-    c = fgetc(f);
-
-    /* default error if not changed by parsing */
-    line_error = "Wrong line format";
-
-    switch(c) {
-    case '#':
-      if (1 == fscanf(f, "%d:", &fileId)) {
-	int i;
-        fgets(buf, sizeof(buf), f);
-	i = strlen(buf);
-	while (i>=1 && isspace(buf[i-1])) {
-	  i--;
-	  buf[i] = 0;
-	}
-        src_info.add_source_file(fileId, std::string(buf));
-	fprintf(stderr, "add_source_file: %d %s\n", fileId, buf);
-	line_error = NULL;
-      }
-      break;
-
-    case '!':
-      if (2 == fscanf(f, "%x:%s\n", &addr, buf)) {
-        src_info.symbol[buf] = addr;
-	line_error = NULL;
-      }
-      break;
-
-    case '@':
-      if (4 == fscanf(f, "%d:%d:%x:%x\n", &fileId, &linenum, &addr, &lastAddr)) {
-	src_info.add_source_line(addr & 0xFFFF, lastAddr & 0xFFFF, fileId, linenum);
-	if (fileId > 0) { /* Assume C source if non 0 file ID found */
-	  entryLabel = "main";
-	}
-	line_error = NULL;
-      }
-      break;
-
-    case 'T':
-      if (2 == fscanf(f, " %d=%s\n", &typeId, buf)) {
-	/* TODO: maybe it's better to have all the parsing/format in one place, so decode the type here */
-	src_info.add_type(typeId, buf);
-	line_error = NULL;
-      }
-      break;
-
-    case 'B':
-      {
-	char kind;
-	char functionName[256];
-	int level;
-        //fgets(buf, sizeof(buf), f);
-	//printf("buf: %s; Ret: %d; kind:%c, n:%s, l:%d, %04x\n", buf, sscanf(buf, " %c:%[^:]:%d:%x\n", &kind, functionName, &level, &addr), kind, functionName, level, addr);
-	//if (4 == sscanf(buf, " %c:%[^:]:%d:%x\n", &kind, functionName, &level, &addr)) {
-	if (4 == fscanf(f, " %c:%[^:]:%d:%x\n", &kind, functionName, &level, &addr)) {
-	  line_error = NULL;
-	  if (kind == 'S') {
-	    src_info.start_declaration_block(functionName, level, addr);
-	  } else if (kind == 'E') {
-	    src_info.finish_declaration_block(functionName, level, addr);
-	  } else {
-	    line_error = "Wrong declaration block kind ('S':start or 'E':end expected)";
-	  }
-	}
-      }
-      break;
-
-    case 'S':
-      {
-	char kind;
-	char functionName[256];
-	char info1[256];
-	char info2[256];
-	int level;
-	if (4 == fscanf(f, " %c%d:%[^:]:%s\n", &kind, &typeId, info1, info2)) {
-	  line_error = NULL;
-	  /* maybe it's better to have all the parsing/format in one place, so we decode the symbol here */
-	  switch (kind) {
-	    case 'G':
-	    case 'S':
-	    case 's':
-	      {
-		VariableKind varKind = (kind=='G') ? FileGlobal : (kind=='S') ? FileStatic : FunctionStatic;
-		// Scope, Type, C (source) name, LC3 (assembler) label
-		src_info.add_absolute_variable(varKind, typeId, info1, info2);
-	      }
-	      break;
-	    case 'l':
-	    case 'p':
-	      {
-		int offset = atoi(info2);
-		VariableKind varKind = (kind=='l') ? FunctionLocal : FunctionParameter;
-		// Scope, Type, C (source) name, Frame offset
-		src_info.add_stack_variable(varKind, typeId, info1, offset);
-	      }
-	      break;
-	    case 'F':
-	    case 'f':
-	      {
-		int isStatic = ('f'==kind); // Is this static or global function
-		// isStatic, ReturnType, C (source) name, LC3 (assembler) label
-		src_info.add_function(isStatic, typeId, info1, info2);
-	      }
-	      break;
-
-	    default:
-	      line_error = "Unrecognised symbol kind";
-	  }
-	}
-      }
-      break;
-
-    default:
-      	line_error = "Unrecognised line type";
-    }
-
-    if (line_error) {
-        fprintf(stderr, "%s in debug information file: %s (line: %d)\n", line_error, debug.c_str(), debugLine);
-        /* read reminder of the line */
-        fgets(buf, sizeof(buf), f);
-    }
-
-  }
-  fprintf(stderr, "---------------------------------------------------------------------------------\n");
-
-  if (pEntry) {
-    if (entryLabel && src_info.symbol.count(entryLabel)) {
-      *pEntry = src_info.symbol[entryLabel];
-    } else {
-      *pEntry = ret;
-    }
-  }
-
-  return ret;
-}
+uint16_t load_prog(const char *file, SourceInfo &src_info, Memory &mem, uint16_t *pEntry);
 
-static int signal_received = 0;
+// simulation of the session on the terminal, interrupted by Ctrl-C
+static RunThread *volatile console_runner = NULL;
 void sigproc(int sig)
 {
   signal(SIGINT, sigproc); /* reset for portability */
   fprintf(stderr, "<Interrupted>\n");
-  signal_received = 1;
-  // TODO: make proper synchronization to avoid race conditions
+  RunThread *runner = console_runner;
+  if (runner) {
+    runner->post(RunThread::INTERRUPT);
+  }
 }
 
 void print_registers(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info, const char *value_sep, const char *reg_sep);
@@ -404,7 +312,7 @@ VariableInfo* find_variable(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info, co
         strcasecmp(name,"MCR")==0) {
 #warning "refactor the variable info into class wich returns the address (depending on the kind of the variable) and is able to print/set the value (depending on it's type)"
       return new VariableInfo(name, CpuSpecial);
-    } else if (cpu_special_variables.count(name)) {     // 3b. Special names (CPU)
+    } else if (session->cpu_special_variables.count(name)) {     // 3b. Special names (CPU)
       return new VariableInfo(name, CpuSpecial);
     } else {
       try {                                             // 4. Absolute address
@@ -429,8 +337,8 @@ void set_variable(VariableInfo *v, LC3::CPU &cpu, Memory &mem, SourceInfo &src_i
       } else if (strcasecmp(v->name,"lc3CPU.MCR")==0 ||
 	  strcasecmp(v->name,"MCR")==0) {
 	mem[0xFFFE] = val;
-      } else if(cpu_special_variables.count(v->name)) {
-	*cpu_special_variables[v->name] = val;
+      } else if(session->cpu_special_variables.count(v->name)) {
+	*session->cpu_special_variables[v->name] = val;
       } else {
 	fprintf(stderr, "Can't set \"%s\" wrong special variable\n", v->name);
       }
@@ -461,8 +369,8 @@ void print_variable(const VariableInfo *v, LC3::CPU &cpu, Memory &mem, SourceInf
     } else if (strcasecmp(v->name,"lc3CPU.MCR")==0 ||
 	strcasecmp(v->name,"MCR")==0) {
       val = mem[0xFFFE] & 0xFFFF;
-    } else if(cpu_special_variables.count(v->name)) {
-      val = *cpu_special_variables[v->name] ;
+    } else if(session->cpu_special_variables.count(v->name)) {
+      val = *session->cpu_special_variables[v->name] ;
     } else {
       fprintf(stderr, "Can't print \"%s\" wrong special variable\n", v->name);
       return;
@@ -510,14 +418,14 @@ void print_displays(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info, bool show_
   DisplayInfoIterator it;
 
   if (!show_values) {
-    if (displays.size()>0) {
+    if (session->displays.size()>0) {
       printf("Num Enb Expression\n");
     } else {
       printf("There are no auto-display expressions now.\n");
     }
   }
-  //for (it=displays.begin(); it != displays.end(); it++) {
-  for (it=displays.rbegin(); it != displays.rend(); ++it) {
+  //for (it=session->displays.begin(); it != session->displays.end(); it++) {
+  for (it=session->displays.rbegin(); it != session->displays.rend(); ++it) {
     printf("%d: ", it->id);
     if (show_values) {
       print_variable(it->variable, cpu, mem, src_info, it->variable.modificator);
@@ -530,8 +438,8 @@ void print_displays(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info, bool show_
 
 int find_display(int id) {
   int i;
-  for (i=0; i < displays.size(); i++) {
-    if (id==displays[i].id) {
+  for (i=0; i < session->displays.size(); i++) {
+    if (id==session->displays[i].id) {
       return i;
     }
   }
@@ -586,28 +494,63 @@ void print_globals(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info, uint16_t sc
   }
 }
 
-/* Construct backtrace for current location */
+/* Drop the backtrace, once the machine changed */
+void forget_backtrace() {
+  for (int i=0; i < session->backtrace.frames.size(); i++) {
+    delete session->backtrace.frames[i];
+  }
+  session->backtrace.frames.clear();
+  session->backtrace.valid = false;
+  session->selected_frame = session->backtrace.frames.end();
+  session->selected_frame_id = 0;
+}
+
+/* Name of the assembly routine starting at entry (or containing the
+ * address, when the entry isn't known) */
+static std::string routine_name(SourceInfo &src_info, std::map<uint16_t, std::string> &labels,
+				uint16_t address, bool is_entry) {
+  if (labels.empty()) {
+    for (std::map<std::string, uint16_t>::const_iterator i = src_info.symbol.begin();
+	 i != src_info.symbol.end(); ++i) {
+      labels.insert(std::make_pair(i->second, i->first));
+    }
+  }
+  std::map<uint16_t, std::string>::const_iterator l = labels.upper_bound(address);
+  if (l != labels.begin() && ((--l)->first == address || !is_entry)) {
+    return l->second;
+  }
+  if (!is_entry) {
+    return "??";
+  }
+  char buf[8];
+  sprintf(buf, "x%.4X", address);
+  return buf;
+}
+
+/* Construct backtrace for current location, from the calls in progress */
 void update_backtrace(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info){
   static char buff[512];
+  const CallStack &calls = session->call_stack;
 
-  if (backtrace.fromPC != cpu.PC) {
-    // remove old
-    for (int i=0; i < backtrace.frames.size(); i++) {
-      delete backtrace.frames[i];
-    }
-    backtrace.frames.clear();
+  if (!session->backtrace.valid) {
+    forget_backtrace();
+    session->backtrace.valid = true;
 
-    // create new
-    backtrace.fromPC = cpu.PC;
     uint16_t scope = cpu.PC;
     uint16_t framePointer = (uint16_t)cpu.R[5];
-    int cnt = 0;
-    SourceBlock *sb;
-
-    do {
-      sb = src_info.find_source_block(scope);
-      if(!sb || !sb->function) {
-	break;
+    size_t level = calls.depth();	// of the call entering the frame
+    std::map<uint16_t, std::string> labels;
+
+    for (int cnt = 0; ; cnt++) {
+      SourceBlock *sb = src_info.find_source_block(scope);
+      FunctionInfo *function = (sb && sb->function) ? sb->function : NULL;
+      std::string name;
+      if (function) {
+	name = function->name;
+      } else if (level > 0) {
+	name = routine_name(src_info, labels, calls[level-1].target, true);
+      } else {
+	name = routine_name(src_info, labels, scope, false);
       }
 
       SourceLocation sl = src_info.find_source_location_short(scope);
@@ -617,16 +560,19 @@ void update_backtrace(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info){
 	snprintf(buff, sizeof(buff), "<unknown source location>");
       }
 
-      backtrace.frames.push_back(new FrameInfo(cnt, scope, framePointer, sb->function, buff));
+      session->backtrace.frames.push_back(new FrameInfo(cnt, scope, framePointer, function, name.c_str(), buff));
 
-      // calculate new frame
-      cnt++;
-      scope = mem[framePointer+2] & 0xFFFF;
-      framePointer = mem[framePointer+1] & 0xFFFF;
-    } while (strcmp(sb->function->name, "main")!=0);
+      // calculate the caller frame, the callers of main are not shown
+      if (level == 0 || (function && strcmp(function->name, "main")==0)) {
+	break;
+      }
+      level--;
+      scope = calls[level].return_address;
+      framePointer = calls[level].frame_pointer;
+    }
 
-    selected_frame = backtrace.frames.begin();
-    selected_frame_id = 0;
+    session->selected_frame = session->backtrace.frames.begin();
+    session->selected_frame_id = 0;
   }
 }
 
@@ -638,64 +584,68 @@ void print_frame(FrameInfo *frame, LC3::CPU &cpu, Memory &mem, SourceInfo &src_i
   if (frame->id) {
     printf("0x%04x ", frame->scope);
   }
-  printf("%s (", function->name);
+  printf("%s (", frame->name);
 
-  std::list<VariableInfo*>::const_iterator it;
-  for (it=function->args.begin(); it != function->args.end(); it++) {
-    if (it!=function->args.begin()) {
-      printf(", ");
+  if (function) {
+    std::list<VariableInfo*>::const_iterator it;
+    for (it=function->args.begin(); it != function->args.end(); it++) {
+      if (it!=function->args.begin()) {
+	printf(", ");
+      }
+      print_variable(*it, cpu, mem, src_info, true);
     }
-    print_variable(*it, cpu, mem, src_info, true);
   }
   printf(") %s\n", frame->sourceLocation);
 }
 
 
-// This is a quick and dirty implementation made in big hurry
-FILE *traceout = NULL;  // enable to get the memory traces
-std::set<uint16_t> w_watchpoints; // addresses for write watchpoints
-std::set<uint16_t> r_watchpoints; // addresses for read watchpoints
-bool watchpoint_was_hit = false;
-
 void set_watchpoint_range(uint16_t first, uint16_t last, char kind) {
-  uint16_t addr;
   if (kind == 'w' || kind == 'a') {
-    for (addr=first; addr <= last; addr++) {
-      w_watchpoints.insert(addr);
-    }
+    session->w_watchpoints.add(first, last);
   }
   if (kind == 'r' || kind == 'a') {
-    for (addr=first; addr <= last; addr++) {
-      r_watchpoints.insert(addr);
-    }
+    session->r_watchpoints.add(first, last);
   }
 }
 
 void clear_watchpoint_range(uint16_t first, uint16_t last, char kind) {
-  uint16_t addr;
-  if (kind == ' ' || kind == 'a') {
-    for (addr=first; addr <= last; addr++) {
-      w_watchpoints.erase(addr);
-    }
+  if (kind == 'w' || kind == 'a') {
+    session->w_watchpoints.remove(first, last);
   }
   if (kind == 'r' || kind == 'a') {
-    for (addr=first; addr <= last; addr++) {
-      r_watchpoints.erase(addr);
-    }
+    session->r_watchpoints.remove(first, last);
   }
 }
 
-// traced memory operations
+// watchpoints of the gdbserver mode, while it runs the program
+static __thread DataWatch *data_watch = NULL;
+
+void set_data_watch(DataWatch *watch)
+{
+  data_watch = watch;
+}
+
+// traced memory operations (plain ones without a session, in the
+// gdbserver mode, but for its watchpoints)
 int16_t mem_read(Memory &mem, uint16_t addr)
 {
   int16_t value = mem[addr];
-  if (r_watchpoints.count(addr)) {
+  if (!session) {
+    if (data_watch) {
+      data_watch->accessed(addr, false);
+    }
+    return value;
+  }
+  if (session->r_watchpoints.contains(addr)) {
         printf("Watchpoint at 0x%04x:\n"
                 " Value = 0x%04x (%d)\n", addr, value & 0xFFFF, value);
-        watchpoint_was_hit = true;
+        session->watchpoint_was_hit = true;
   }
-  if (traceout) {
-    fprintf(traceout, "MEM[%04x] RD %04x\n", addr & 0xFFFF, value & 0xFFFF);
+  if (session->traceout) {
+    fprintf(session->traceout, "MEM[%04x] RD %04x\n", addr & 0xFFFF, value & 0xFFFF);
+  }
+  if (!mem.is_mapped(addr)) {
+    session->undo_log.read(addr);
   }
   return value;
 }
@@ -703,19 +653,346 @@ int16_t mem_read(Memory &mem, uint16_t addr)
 // traced memory operations
 void mem_write(Memory &mem, uint16_t addr, int16_t value)
 {
+  if (!session) {
+    if (data_watch) {
+      data_watch->accessed(addr, true);
+    }
+    mem[addr] = value;
+    return;
+  }
   int16_t oldValue = mem[addr];
-  if (w_watchpoints.count(addr)) {
+  if (session->w_watchpoints.contains(addr)) {
         printf("Watchpoint at 0x%04x:\n"
                 " Old Value = 0x%04x (%d)\n"
                 " New Value = 0x%04x (%d)\n", addr, oldValue& 0xFFFF, oldValue, value& 0xFFFF, value);
-        watchpoint_was_hit = true;
+        session->watchpoint_was_hit = true;
+  }
+  if (session->traceout) {
+    fprintf(session->traceout, "MEM[%04x] WR %04x\n", addr & 0xFFFF, value & 0xFFFF);
   }
-  if (traceout) {
-    fprintf(traceout, "MEM[%04x] WR %04x\n", addr & 0xFFFF, value & 0xFFFF);
+  if (!mem.is_mapped(addr)) {
+    session->undo_log.write(addr, oldValue);
   }
   mem[addr] = value;
 }
 
+enum ReverseMode
+{
+  ReverseStepi,
+  ReverseNext,
+  ReverseContinue
+};
+
+// Executes backward by undoing the logged steps, until COUNT instructions
+// (reverse-stepi), the start of the previous source line (reverse-next) or
+// a breakpoint/watchpoint.  The calls are stepped over by counting the
+// returns and calls undone.
+static void reverse_execute(LC3::CPU &cpu, Memory &mem, SourceInfo &src_info,
+			    UserBreakpoits &breakpoints, ReverseMode mode, int count)
+{
+  UndoLog &log = session->undo_log;
+  UndoLog::Step step;
+  int depth = 0;
+  SourceLocation line = src_info.find_source_location_absolute(cpu.PC);
+  bool hll_line = (line.lineNo > 0 && line.isHLLSource);
+  bool left_line = false;
+
+  if (log.limit() == 0) {
+    printf("No execution history is recorded, use `record' first.\n");
+    return;
+  }
+  session->runner.take();	// the interrupts typed at the prompt
+
+  for (;;) {
+    uint16_t next_pc = cpu.PC;
+    if (!log.undo(cpu, mem, step)) {
+      printf("\nNo more reverse-execution history.\n");
+      break;
+    }
+
+    int calls = step.interrupt ? 1 : LC3::CPU::depth_change(mem[cpu.PC], cpu.PC, next_pc);
+    depth -= calls;
+    cpu.depth -= calls;
+    if (calls > 0) {
+      session->call_stack.undo_call();
+    } else if (calls < 0) {
+      session->call_stack.undo_return();
+    }
+
+    bool stop = false;
+    for (int i=0; i < step.writes; i++) {
+      uint16_t addr = step.address[i];
+      if (session->w_watchpoints.contains(addr)) {
+	int16_t value = mem[addr];
+	printf("Watchpoint at 0x%04x:\n"
+	       " Restored Value = 0x%04x (%d)\n", addr, value & 0xFFFF, value);
+	stop = true;
+      }
+    }
+    for (int i=0; i < step.reads; i++) {
+      uint16_t addr = step.read_address[i];
+      if (session->r_watchpoints.contains(addr)) {
+	int16_t value = mem[addr];
+	printf("Watchpoint at 0x%04x:\n"
+	       " Value = 0x%04x (%d)\n", addr, value & 0xFFFF, value);
+	stop = true;
+      }
+    }
+    if (breakpoints.watching() && breakpoints.checkWatches(session->call_stack.depth())) {
+      stop = true;
+    }
+    // the next run starts at a breakpoint already hit, see run_loop()
+    session->breakpoint_hit = false;
+    if (stop) {
+      break;
+    }
+    if (breakpoints.check(cpu.PC)) {
+      session->breakpoint_hit = true;
+      break;
+    }
+    if (session->runner.take() & RunThread::INTERRUPT) {
+      break;
+    }
+
+    if (mode == ReverseStepi) {
+      if (--count <= 0) {
+	break;
+      }
+    } else if (mode == ReverseNext) {
+      if (depth < 0) {
+	// went back out of the function, to its call
+	break;
+      }
+      if (depth > 0) {
+	continue;
+      }
+      if (!hll_line) {
+	break;
+      }
+      if (!left_line && cpu.PC >= line.firstAddr && cpu.PC <= line.lastAddr) {
+	continue;
+      }
+      // In the previous line, go to its start
+      if (!left_line) {
+	left_line = true;
+	line = src_info.find_source_location_absolute(cpu.PC);
+	if (line.lineNo <= 0 || !line.isHLLSource) {
+	  break;
+	}
+      }
+      if (cpu.PC == line.firstAddr || log.empty()) {
+	break;
+      }
+      uint16_t prev = log.last_pc();
+      if ((prev < line.firstAddr || prev > line.lastAddr) &&
+	  !log.last_is_interrupt() && LC3::CPU::depth_change(mem[prev]) >= 0) {
+	break;
+      }
+    }
+  }
+}
+
+// An execution command (run, continue, step...), and where it stops
+struct RunJob {
+  DebugSession *session;
+  LC3::CPU *cpu;
+  Memory *mem;
+  Hardware *hw;
+  UserBreakpoits *breakpoints;
+  int instructions_to_run;
+  int limit_execution_range_start;
+  int limit_execution_range_end;
+  bool step_over_calls;	// don't stop inside the calls (next, nexti, until)
+  bool finishing;
+  int frame_depth;	// stop when this frame returns
+};
+
+// Debugging features a run loop is compiled for, the loop without any
+// only executes the instructions
+enum RunFeatures {
+  RUN_RECORD = 1,	// execution history for the reverse execution
+  RUN_BREAK = 2,	// enabled breakpoints
+  RUN_WATCH = 4,	// watchpoints or watched expressions
+  RUN_STEP = 8,		// stop out of an address range or a frame (step, next, finish...)
+  RUN_PROFILE = 16,
+  RUN_COVERAGE = 32,
+  RUN_FEATURES = 64	// number of the loops
+};
+
+// Executes the job until it stops, a breakpoint or watchpoint is hit, the
+// machine halts or an interrupt is requested
+template <unsigned FEATURES>
+static void run_loop(RunJob &job)
+{
+  LC3::CPU &cpu = *job.cpu;
+  Memory &mem = *job.mem;
+  Hardware &hw = *job.hw;
+  UserBreakpoits &breakpoints = *job.breakpoints;
+  RunThread &runner = session->runner;
+
+  while (job.instructions_to_run) {
+    runner.publish(cpu, session->instruction_count);
+    if (runner.take() & RunThread::INTERRUPT) {
+      return;
+    }
+
+    for (int n = RunThread::CHUNK; n && job.instructions_to_run; n--) {
+      job.instructions_to_run--;
+
+      // Check stoping conditions
+      if (hw.halted()) {
+	fprintf(stderr, "LC3 is halted. Set the 0x8000 bit of mem[0xFFFE] to run it again.\n");
+	return;
+      }
+      if ((FEATURES & RUN_WATCH) && session->watchpoint_was_hit) {
+	return;
+      }
+      if ((FEATURES & RUN_BREAK) && !session->breakpoint_hit && breakpoints.check(cpu.PC)) {
+	session->breakpoint_hit = true;
+	return;
+      }
+
+      // Execute
+      uint16_t pc = cpu.PC;
+      int depth = cpu.depth;
+      if (FEATURES & RUN_PROFILE) {
+	session->profiler->executed(pc);
+      }
+      if (FEATURES & RUN_RECORD) {
+	session->undo_log.begin(cpu);
+      }
+      cpu.cycle();
+      if (FEATURES & RUN_RECORD) {
+	session->undo_log.end(cpu);
+      }
+      uint16_t next_pc = cpu.PC;
+      int calls = cpu.depth - depth;
+      if (FEATURES & RUN_COVERAGE) {
+	session->coverage->executed(pc, next_pc);
+      }
+      if (FEATURES & RUN_RECORD) {
+	session->undo_log.begin(cpu);
+      }
+      mem.cycle();
+      if (FEATURES & RUN_RECORD) {
+	session->undo_log.end(cpu, true);
+      }
+      if (calls || cpu.PC != next_pc) {
+	session->call_stack.executed(pc, calls, next_pc, cpu.PC, cpu.R[5], session->undo_log.steps(),
+				     session->profiler ? session->profiler->clock() : 0,
+				     (FEATURES & RUN_PROFILE) ? session->profiler : NULL);
+      }
+      session->instruction_count++;
+      if ((FEATURES & RUN_WATCH) && breakpoints.watching() &&
+	  breakpoints.checkWatches(session->call_stack.depth())) {
+	session->watchpoint_was_hit = true;
+      }
+      if (FEATURES & RUN_BREAK) {
+	session->breakpoint_hit = false;
+      }
+
+      if (FEATURES & RUN_STEP) {
+	if (job.step_over_calls || job.finishing) {
+	  if (cpu.depth < job.frame_depth) {
+	    // returned from the frame
+	    return;
+	  }
+	  if (cpu.depth > job.frame_depth && job.step_over_calls) {
+	    // in a call, run until it returns
+	    if (!job.instructions_to_run) {
+	      job.instructions_to_run = 1;
+	    }
+	    continue;
+	  }
+	}
+	if (cpu.PC < job.limit_execution_range_start ||
+	    cpu.PC > job.limit_execution_range_end) {
+	  return;
+	}
+      }
+    }
+  }
+}
+
+typedef void (*RunLoop)(RunJob &job);
+
+// Table of the run loops, indexed by the features
+template <unsigned FEATURES>
+struct RunLoops {
+  static void fill(RunLoop *loops) {
+    loops[FEATURES] = &run_loop<FEATURES>;
+    RunLoops<FEATURES - 1>::fill(loops);
+  }
+};
+
+template <>
+struct RunLoops<0> {
+  static void fill(RunLoop *loops) {
+    loops[0] = &run_loop<0>;
+  }
+};
+
+// Executes the job on the simulation thread, by the loop compiled for the
+// features in use when it starts
+static void run_job(void *arg)
+{
+  RunJob &job = *(RunJob *)arg;
+  RunLoop loops[RUN_FEATURES];
+  unsigned features = 0;
+
+  session = job.session;
+  session->watchpoint_was_hit = false;
+
+  if (session->undo_log.limit() != 0) {
+    features |= RUN_RECORD;
+  }
+  if (job.breakpoints->breaking()) {
+    features |= RUN_BREAK;
+  } else {
+    session->breakpoint_hit = false;
+  }
+  if (!session->w_watchpoints.empty() || !session->r_watchpoints.empty() ||
+      job.breakpoints->watching()) {
+    features |= RUN_WATCH;
+  }
+  if (job.step_over_calls || job.finishing || job.limit_execution_range_start > 0 ||
+      job.limit_execution_range_end < 0xFFFF) {
+    features |= RUN_STEP;
+  }
+  if (session->profiling) {
+    features |= RUN_PROFILE;
+  }
+  if (session->covering) {
+    features |= RUN_COVERAGE;
+  }
+
+  RunLoops<RUN_FEATURES - 1>::fill(loops);
+  loops[features](job);
+  session->runner.publish(*job.cpu, session->instruction_count);
+}
+
+// One ore more instructions have been executed. Show the stopped location to the user.
+static void show_stop(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
+		      bool gui_mode, bool quiet_mode)
+{
+  hw.flush();
+  forget_backtrace();
+  show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
+}
+
+// Registers published by a job running in the background
+static void print_status(const RunThread::Status &status)
+{
+  for (int i = 0; i < 8; i++) {
+    printf("R%d\t0x%.4x %d\n", i, status.R[i] & 0xFFFF, status.R[i]);
+  }
+  printf("PC\t0x%.4x %5d\n", status.PC, status.PC);
+  printf("PSR\t0x%.4x %s Pri:%.1x %c%c%c\n", status.PSR,
+	 (status.PSR & 0x8000) ? "User" : "Kern", (status.PSR >> 8) & 0x7,
+	 (status.PSR&0x4)?'N':'-', (status.PSR&0x2)?'Z':'-', (status.PSR&0x1)?'P':'-');
+  printf("Instructions Run: %d\n", status.instructions);
+}
+
 
 int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	     bool gui_mode, bool quiet_mode, const char *exec_file)
@@ -727,32 +1004,34 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
   char x_string[256];
   char sys_string[2048];
 
-  int instruction_count = 0;
+  DebugSession this_session;
+  session = &this_session;
+  __sync_bool_compare_and_swap(&console_runner, (RunThread *)NULL, &session->runner);
 
   if (!quiet_mode) {
     printf("Type `help' for a list of commands.\n");
   }
 
-  cpu_special_variables["R0"] = &cpu.R[0];
-  cpu_special_variables["R1"] = &cpu.R[1];
-  cpu_special_variables["R2"] = &cpu.R[2];
-  cpu_special_variables["R3"] = &cpu.R[3];
-  cpu_special_variables["R4"] = &cpu.R[4];
-  cpu_special_variables["R5"] = &cpu.R[5];
-  cpu_special_variables["R6"] = &cpu.R[6];
-  cpu_special_variables["R7"] = &cpu.R[7];
-  cpu_special_variables["PC"] = (int16_t *)&cpu.PC;
-  cpu_special_variables["PSR"] = (int16_t *)&cpu.PSR;
-  cpu_special_variables["lc3CPU.R0"] = &cpu.R[0];
-  cpu_special_variables["lc3CPU.R1"] = &cpu.R[1];
-  cpu_special_variables["lc3CPU.R2"] = &cpu.R[2];
-  cpu_special_variables["lc3CPU.R3"] = &cpu.R[3];
-  cpu_special_variables["lc3CPU.R4"] = &cpu.R[4];
-  cpu_special_variables["lc3CPU.R5"] = &cpu.R[5];
-  cpu_special_variables["lc3CPU.R6"] = &cpu.R[6];
-  cpu_special_variables["lc3CPU.R7"] = &cpu.R[7];
-  cpu_special_variables["lc3CPU.PC"] = (int16_t *)&cpu.PC;
-  cpu_special_variables["lc3CPU.PSR"] = (int16_t *)&cpu.PSR;
+  session->cpu_special_variables["R0"] = &cpu.R[0];
+  session->cpu_special_variables["R1"] = &cpu.R[1];
+  session->cpu_special_variables["R2"] = &cpu.R[2];
+  session->cpu_special_variables["R3"] = &cpu.R[3];
+  session->cpu_special_variables["R4"] = &cpu.R[4];
+  session->cpu_special_variables["R5"] = &cpu.R[5];
+  session->cpu_special_variables["R6"] = &cpu.R[6];
+  session->cpu_special_variables["R7"] = &cpu.R[7];
+  session->cpu_special_variables["PC"] = (int16_t *)&cpu.PC;
+  session->cpu_special_variables["PSR"] = (int16_t *)&cpu.PSR;
+  session->cpu_special_variables["lc3CPU.R0"] = &cpu.R[0];
+  session->cpu_special_variables["lc3CPU.R1"] = &cpu.R[1];
+  session->cpu_special_variables["lc3CPU.R2"] = &cpu.R[2];
+  session->cpu_special_variables["lc3CPU.R3"] = &cpu.R[3];
+  session->cpu_special_variables["lc3CPU.R4"] = &cpu.R[4];
+  session->cpu_special_variables["lc3CPU.R5"] = &cpu.R[5];
+  session->cpu_special_variables["lc3CPU.R6"] = &cpu.R[6];
+  session->cpu_special_variables["lc3CPU.R7"] = &cpu.R[7];
+  session->cpu_special_variables["lc3CPU.PC"] = (int16_t *)&cpu.PC;
+  session->cpu_special_variables["lc3CPU.PSR"] = (int16_t *)&cpu.PSR;
 
 
 #if defined(USE_READLINE)
@@ -765,13 +1044,10 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
   std::string last_cmd;
 
   UserBreakpoits breakpoints(src_info);
-  bool break_on_return;
-  bool breakpoint_hit = false;	// Flag set once breakpoint is detected, so that breakpointed instruction can be enabled.
-  int temporary_breakpoint = -1;
+  RunJob job;
+  bool running_in_background = false;
   int repeat_count = 0;
   const int INT_INFINITY = 0x7FFFFFFF;
-  int saved_execution_range_start = 0;
-  int saved_execution_range_end = INT_INFINITY;
   uint16_t selected_scope = cpu.PC;
 
 //  show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
@@ -782,17 +1058,16 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
   }
 
   signal(SIGINT, sigproc);
-  break_on_return = false;
   for(;
       cmdline = readline(quiet_mode ? "(gdb) " : "(lc3db) ");
       free(cmdline)) try {
     int instructions_to_run = 0;
     int limit_execution_range_start = 0;
     int limit_execution_range_end = INT_INFINITY;
-    int step_over_calls = 0;
-    int in_step_over_mode = 0;
+    bool step_over_calls = false;	// don't stop inside the calls (next, nexti, until)
+    bool finishing = false;
+    int frame_depth = cpu.depth;	// stop when this frame returns
     int show_help = 0;
-    watchpoint_was_hit = 0;
 
 #define CMD_HELP(msg) \
       if (show_help) { \
@@ -811,7 +1086,15 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 #endif
     }
 
-    std::istringstream incmd(cmd);
+    // `COMMAND &' runs the program in the background
+    std::string line(cmd);
+    size_t last = line.find_last_not_of(" \t");
+    bool background = (last != std::string::npos && line[last] == '&');
+    if (background) {
+      line.erase(last);
+    }
+
+    std::istringstream incmd(line);
     std::string cmdstr;
 
     cmdstr.clear();
@@ -819,6 +1102,30 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
     param2.clear();
     incmd >> cmdstr;
 
+    if (running_in_background && !session->runner.busy()) {
+      // stopped since the last command
+      running_in_background = false;
+      selected_scope = cpu.PC;
+      show_stop(cpu, src_info, mem, hw, gui_mode, quiet_mode);
+    }
+    if (running_in_background && cmdstr != "help" && cmdstr != "h" &&
+	cmdstr != "exit" && cmdstr != "quit" && cmdstr != "q") {
+      incmd >> param1;
+      if (cmdstr == "interrupt") {
+	session->runner.post(RunThread::INTERRUPT);
+	session->runner.wait();
+	running_in_background = false;
+	selected_scope = cpu.PC;
+	show_stop(cpu, src_info, mem, hw, gui_mode, quiet_mode);
+      } else if (cmdstr == "info" && (param1 == "registers" || param1 == "r")) {
+	print_status(session->runner.status());
+      } else {
+	printf("Cannot execute this command while the target is running.\n"
+	       "Use the \"interrupt\" command to stop the target and then try again.\n");
+      }
+      continue;
+    }
+
 #warning "TODO: Make machine initialization and loading of the system and user .obj files intuitive"
     /* 1. When lc3db is started, the lc3os is loaded and PC initialized at it's start??
      * 2. When loading the obj file, the memory is loaded and breakpoint is set for entry point (main for C source)
@@ -871,6 +1178,9 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       else {
 	printf("Loading lib/los.obj\n");
       }
+      if (pc != 0xFFFF) {
+	hw.record_os_traps();
+      }
 
       // Load executable if specified
       if (exec_file) {
@@ -881,7 +1191,9 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	  printf("failed to load %s\n", exec_file);
 	} else {
 	  mem[0x01FE] = start_addr;
-	  int bt_id = breakpoints.add(entry, false);
+	  if (!breakpoints.find(entry)) {
+	    breakpoints.add(entry, false);
+	  }
 	  //temporary_breakpoint = start_addr;
 	}
       }
@@ -889,14 +1201,26 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       if (pc != 0xFFFF) {
 	cpu.PC = mem[0x01FF];
 	cpu.PSR = 0x0000;
+	cpu.depth = 0;
+	session->undo_log.clear();
+	session->call_stack.clear();
 	instructions_to_run = INT_INFINITY;
 	mem[0xFFFE] = mem[0xFFFE] | 0x8000;
       } else {
 	printf("Could not find los.obj\n");
       }
     } else if (cmdstr == "finish") {
-      CMD_HELP(("Continue until return (or until breakpoint is hit).\n"));
-      break_on_return = true;
+      CMD_HELP(("Continue until the selected frame returns (or until breakpoint is hit).\n"));
+      update_backtrace(cpu, mem, src_info);
+      size_t depth = session->call_stack.depth();
+      if (session->backtrace.frames.empty() || session->selected_frame_id >= depth) {
+	printf("\"finish\" not meaningful in the outermost frame.\n");
+	continue;
+      }
+      printf("Run till exit from ");
+      print_frame(*session->selected_frame, cpu, mem, src_info);
+      finishing = true;
+      frame_depth = cpu.depth - session->selected_frame_id;
       instructions_to_run = INT_INFINITY;
     } else if (cmdstr == "set") {
       incmd >> param1;
@@ -921,9 +1245,54 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	VariableInfo v = find_variable(cpu, mem, src_info, param1.c_str(), selected_scope);
 	if (v) {
 	  set_variable(v, cpu, mem, src_info, param2);
+	  forget_backtrace();
 	} else {
 	  fprintf(stderr, "variable \"%s\" not found\n", param1.c_str());
 	}
+      } else if (param1 == "output") {
+	CMD_HELP(
+	    ("  set output buffered|unbuffered\n"
+	     "The output of the debugged program is buffered until a newline, until the program stops\n"
+	     "or until it does not print for a while. Use `unbuffered' to see every character as soon as it is written.\n"
+	    ));
+	param1.clear();
+	incmd >> param1;
+	if (param1 == "buffered") {
+	  hw.set_buffered_output(true);
+	} else if (param1 == "unbuffered") {
+	  hw.set_buffered_output(false);
+	} else {
+	  fprintf(stderr, "Expected \"buffered\" or \"unbuffered\". See: \"help set output\"\n");
+	}
+      } else if (param1 == "traps") {
+	CMD_HELP(
+	    ("  set traps native|os\n"
+	     "With `native' the simulator does the console TRAPs (GETC, OUT, PUTS and IN) itself,\n"
+	     "without running the routines of the OS which poll the devices a character at a time.\n"
+	     "GETC and IN still run the routine of the OS while no key is typed.\n"
+	     "The default is `os': the routines are executed, so they can be stepped into and stopped at by breakpoints.\n"
+	    ));
+	param1.clear();
+	incmd >> param1;
+	if (param1 == "native") {
+	  hw.set_native_traps(true);
+	} else if (param1 == "os") {
+	  hw.set_native_traps(false);
+	} else {
+	  fprintf(stderr, "Expected \"native\" or \"os\". See: \"help set traps\"\n");
+	}
+      } else if (param1 == "record-size") {
+	CMD_HELP(
+	    ("  set record-size KBYTES\n"
+	     "Memory used for the execution history of the reverse execution commands (1024 when started by `record').\n"
+	     "Starts the recording when it is off; the oldest instructions are forgotten when it is full,\n"
+	     "0 stops the recording.\n"
+	     "The devices are not rewound: the output stays written and the input read.\n"
+	    ));
+	param1.clear();
+	incmd >> param1;
+	size_t kbytes = lexical_cast<uint16_t>(param1);
+	session->undo_log.set_limit(kbytes * 1024);
       } else {
 	  fprintf(stderr, "\"set\" command is only supported for setting simple variables. See: \"help set variable\"\n");
       }
@@ -948,7 +1317,7 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 		 cpu.PSR & 0xFFFF, cpu.PSR & 0xFFFF,
 		 mem[0xFFFE] & 0xFFFF, mem[0xFFFE] & 0xFFFF,
                  mem[0xFFFF] & 0xFFFF, mem[0xFFFF] & 0xFFFF,
-		 instruction_count,
+		 session->instruction_count,
 		 (cpu.PSR & 0x8000) ? "User  " : "Kernel",
 		 (cpu.PSR >> 8) & 0x7, (cpu.PSR&0x4)?'1':'0',
                  (cpu.PSR&0x2)?'1':'0', (cpu.PSR&0x1)?'1':'0');
@@ -1000,6 +1369,175 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	    ));
       incmd >> param1;
       hw.set_tty(open(param1.c_str(), O_RDWR));
+    } else if (cmdstr == "save") {
+      CMD_HELP((
+	    "  save [NAME]\n"
+	    "Save the state of the machine (registers, memory and devices) under NAME,\n"
+	    "`restore NAME' goes back to it.  The memory is copied on write, so saving\n"
+	    "is cheap.  Saving under an existing NAME replaces the saved state.\n"
+	    ));
+      incmd >> param1;
+      Checkpoint *&checkpoint = session->checkpoints[param1];
+      delete checkpoint;
+      checkpoint = new Checkpoint(cpu, mem, hw);
+      session->checkpoint_calls[param1] = session->call_stack;
+      printf("Saved the machine state%s%s at PC=x%.4X\n",
+	     param1.empty() ? "" : " ", param1.c_str(), cpu.PC);
+    } else if (cmdstr == "restore") {
+      CMD_HELP((
+	    "  restore [NAME]\n"
+	    "Restore the state of the machine saved by `save [NAME]' command.\n"
+	    "The state is kept, so it can be restored again.  The output of the program\n"
+	    "is not taken back and the unread input is not given back.\n"
+	    ));
+      incmd >> param1;
+      std::map<std::string, Checkpoint*>::iterator i = session->checkpoints.find(param1);
+      if (i == session->checkpoints.end()) {
+	printf("No machine state saved%s%s\n", param1.empty() ? "" : " as ", param1.c_str());
+	continue;
+      }
+      i->second->restore();
+      session->undo_log.clear();
+      session->call_stack = session->checkpoint_calls[param1];
+      selected_scope = cpu.PC;
+      forget_backtrace();
+      show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
+    } else if (cmdstr == "profile") {
+      CMD_HELP((
+	    "  profile on|off|reset\n"
+	    "  profile callgrind FILENAME\n"
+	    "Count how many times every instruction is executed, and the instructions\n"
+	    "executed inside the function calls (TRAPs and interrupts included).\n"
+	    "`profile off' stops counting, the counts are kept until `profile reset'.\n"
+	    "`info profile' shows the hottest functions and source lines, `profile\n"
+	    "callgrind' writes the profile to FILENAME in the format of KCachegrind.\n"
+	    ));
+      incmd >> param1;
+      if (param1 == "on") {
+	if (!session->profiler) {
+	  session->profiler = new Profiler();
+	}
+	session->profiling = true;
+      } else if (param1 == "off") {
+	session->profiling = false;
+	if (session->profiler) {
+	  printf("Profiled %llu instructions\n",
+		 (unsigned long long)session->profiler->instructions());
+	}
+      } else if (param1 == "reset") {
+	if (session->profiler) {
+	  session->profiler->reset();
+	}
+      } else if (param1 == "callgrind") {
+	incmd >> param2;
+	if (param2.empty()) {
+	  printf("Usage: profile callgrind FILENAME\n");
+	} else if (!session->profiler) {
+	  printf("No profile, use `profile on' first\n");
+	} else if (!session->profiler->write_callgrind(src_info, session->call_stack,
+							 param2.c_str())) {
+	  printf("Can't write %s: %s\n", param2.c_str(), strerror(errno));
+	}
+      } else {
+	printf("Profiling is %s\n", session->profiling ? "on" : "off");
+      }
+    } else if (cmdstr == "coverage") {
+      CMD_HELP((
+	    "  coverage on|off|reset\n"
+	    "  coverage lcov FILENAME\n"
+	    "Record which instructions are executed and which way the conditional\n"
+	    "branches go.  `coverage off' stops recording, the record is kept until\n"
+	    "`coverage reset'.  `coverage lcov' writes the covered C and assembly lines,\n"
+	    "functions and branches to FILENAME in the tracefile format of lcov, for\n"
+	    "genhtml.  Use `lc3run --coverage' to sum the coverage of many runs.\n"
+	    ));
+      incmd >> param1;
+      if (param1 == "on") {
+	if (!session->coverage) {
+	  session->coverage = new Coverage();
+	}
+	session->covering = true;
+      } else if (param1 == "off") {
+	session->covering = false;
+      } else if (param1 == "reset") {
+	if (session->coverage) {
+	  session->coverage->reset();
+	}
+      } else if (param1 == "lcov") {
+	incmd >> param2;
+	CoverageReport report;
+	if (param2.empty()) {
+	  printf("Usage: coverage lcov FILENAME\n");
+	} else if (!session->coverage) {
+	  printf("No coverage, use `coverage on' first\n");
+	} else {
+	  report.add(*session->coverage, src_info, mem);
+	  if (!report.write(param2.c_str(), "")) {
+	    printf("Can't write %s: %s\n", param2.c_str(), strerror(errno));
+	  }
+	}
+      } else {
+	printf("Coverage is %s\n", session->covering ? "on" : "off");
+      }
+    } else if (cmdstr == "record" || cmdstr == "rec") {
+      CMD_HELP(
+	  ("  record|rec [stop]\n"
+	   "Start recording the execution history used by the reverse execution commands.\n"
+	   "The recording slows down the run, `record stop' deletes the history and ends it.\n"
+	   "See also: help set record-size\n"
+	  ));
+      param1.clear();
+      incmd >> param1;
+      if (param1 == "stop") {
+	if (session->undo_log.limit() == 0) {
+	  printf("No execution history is being recorded.\n");
+	} else {
+	  session->undo_log.set_limit(0);
+	  printf("Recording stopped, the execution history is deleted.\n");
+	}
+      } else if (!param1.empty() && param1 != "full") {
+	fprintf(stderr, "Expected nothing or \"stop\". See: \"help record\"\n");
+      } else if (session->undo_log.limit() != 0) {
+	printf("The execution history is already being recorded.\n");
+      } else {
+	session->undo_log.set_limit(DEFAULT_UNDO_LOG_SIZE);
+      }
+    } else if (cmdstr == "reverse-stepi" || cmdstr == "rsi") {
+      CMD_HELP(
+	  ("  reverse-stepi|rsi [COUNT]\n"
+	   "Go back by single instruction (or COUNT instructions if specified).\n"
+	   "The registers and memory are restored from the execution history recorded since `record'.\n"
+	  ));
+      incmd >> param1;
+      int count;
+      try {
+	count = lexical_cast<uint16_t>(param1);
+      } catch(bad_lexical_cast &e) {
+	count = 1;
+      }
+      reverse_execute(cpu, mem, src_info, breakpoints, ReverseStepi, count);
+      selected_scope = cpu.PC;
+      forget_backtrace();
+      show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
+    } else if (cmdstr == "reverse-next" || cmdstr == "rn") {
+      CMD_HELP(
+	  ("  reverse-next|rn\n"
+	   "Go back to the start of the previous source line (or by one instruction in assembly code).\n"
+	   "The function calls are stepped over, the breakpoints and watchpoints are honored.\n"
+	  ));
+      reverse_execute(cpu, mem, src_info, breakpoints, ReverseNext, 1);
+      selected_scope = cpu.PC;
+      forget_backtrace();
+      show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
+    } else if (cmdstr == "reverse-continue" || cmdstr == "rc") {
+      CMD_HELP(
+	  ("  reverse-continue|rc\n"
+	   "Go back untill a breakpoint or watchpoint is hit or untill the start of the execution history.\n"
+	  ));
+      reverse_execute(cpu, mem, src_info, breakpoints, ReverseContinue, 0);
+      selected_scope = cpu.PC;
+      forget_backtrace();
+      show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
     } else if (cmdstr == "continue" || cmdstr == "c" || cmdstr=="cont") {
       CMD_HELP(("Continues execution untill the breakpoint is hit or machine is halted.\n"));
       printf("running\n");
@@ -1051,11 +1589,17 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       uint16_t pc = load_prog(param1.c_str(), src_info, mem, &entry);
       if (pc != 0xFFFF) {
 	cpu.PC = pc;
+	cpu.depth = 0;
+	session->undo_log.clear();
+	session->call_stack.clear();
+	forget_backtrace();
 	//const char *file = "";
 	//if (!mem.debug[cpu.PC].empty()) {
 	//  file = mem.debug[cpu.PC].c_str();
 	//}
-	int bt_id = breakpoints.add(entry, false);
+	if (!breakpoints.find(entry)) {
+	  breakpoints.add(entry, false);
+	}
 	show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
         printf("Use 'run' command to start the simulation of loaded object\n");
 	mem[0xFFFE] = mem[0xFFFE] | 0x8000;
@@ -1080,7 +1624,7 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	   "NOTE: the COUNT argument is not yet supported by nexti.\n"
 	  ));
       instructions_to_run = 1;
-      step_over_calls = 1;
+      step_over_calls = true;
     } else if (cmdstr == "step" || cmdstr == "s") {
       CMD_HELP(
 	  ("  step|s [COUNT]\n"
@@ -1116,13 +1660,28 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       if (line.lineNo <= 0 || !line.isHLLSource) {
 	// No hi level line at current location
 	instructions_to_run = 1;
-	step_over_calls = 1;
+	step_over_calls = true;
       } else {
 	instructions_to_run = INT_INFINITY;
-	step_over_calls = 1;
+	step_over_calls = true;
 	limit_execution_range_start = line.firstAddr;
 	limit_execution_range_end = line.lastAddr;
       }
+    } else if (cmdstr == "until" || cmdstr == "u") {
+      CMD_HELP(
+	  ("  until|u\n"
+	   "Continue until a source line past the current one is reached, like `next', but without\n"
+	   "stopping when jumping back (at the end of a loop).  Stops also when the current frame returns.\n"
+	  ));
+      SourceLocation line = src_info.find_source_location_absolute(cpu.PC);
+      step_over_calls = true;
+      if (line.lineNo <= 0 || !line.isHLLSource) {
+	// No hi level line, past the current instruction
+	limit_execution_range_end = cpu.PC;
+      } else {
+	limit_execution_range_end = line.lastAddr;
+      }
+      instructions_to_run = INT_INFINITY;
     } else if (cmdstr == "ignore") {
       CMD_HELP(
 	  ("  ignore BREAKPOINT_ID COUNT\n"
@@ -1139,16 +1698,19 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       }
     } else if (cmdstr == "break" || cmdstr == "b" ||
 	       cmdstr == "tbreak" || cmdstr == "tb") {
-      uint16_t bp_addr;
+      uint16_t bp_addr = 0;
       bool bp_valid = false;
       size_t colPos;
       incmd >> param1;
       bool make_temporary = (cmdstr[0] == 't');
       CMD_HELP(
-          ("  break SYMBOL\n"
-           "  break FILENAME:LINENO\n"
-           "  break ADDRESS\n"
+          ("  break SYMBOL [if EXPRESSION]\n"
+           "  break FILENAME:LINENO [if EXPRESSION]\n"
+           "  break ADDRESS [if EXPRESSION]\n"
            "Creates the breakpoint (temporary breakpoint is created with `tbreak' command).\n"
+           "With the condition, the execution stops only if the EXPRESSION is not zero.\n"
+           "The EXPRESSION is made of numbers, C variables of the breakpoint location,\n"
+           "assembler labels, registers, *ADDRESS, &VARIABLE and C operators.\n"
           ));
 
       if (src_info.symbol.count(param1)) {
@@ -1176,8 +1738,23 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	bp_valid = true;
       }
 
+      Expression *condition = NULL;
+      std::string rest;
+      getline(incmd, rest);
+      size_t ifPos = rest.find_first_not_of(" \t");
+      if (ifPos != std::string::npos) {
+	if (rest.compare(ifPos, 3, "if ") != 0 || !bp_valid) {
+	  printf("breakpoint specification [%s%s] is not valid\n", param1.c_str(), rest.c_str());
+	  continue;
+	}
+	condition = Expression::compile(rest.substr(ifPos + 3), src_info, bp_addr, cpu, mem);
+	if (!condition) {
+	  continue;
+	}
+      }
+
       if (bp_valid) {
-	int bt_id = breakpoints.add(bp_addr, make_temporary);
+	int bt_id = breakpoints.add(bp_addr, make_temporary, condition);
       } else {
 	printf("breakpoint specification [%s] is not valid\n", param1.c_str());
       }
@@ -1197,18 +1774,44 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
              "Clear watchpoints on %s of addresses\n", cmdstr.c_str(), (kind == 'w') ? "write" : (kind == 'r') ? "read" : "access"
             ));
       } 
+      if (kind == 'w') {
+        CMD_HELP(
+            ("  watch FIRST_ADDR LAST_ADDR\n"
+             "Set watchpoints on write of addresses\n"
+             "  watch EXPRESSION\n"
+             "Stop when the value of the EXPRESSION changes (checked after each instruction).\n"
+             "An EXPRESSION on the locals of the current function is checked only in its frame,\n"
+             "the watchpoint is deleted when the frame returns.\n"
+             "See `help break' for the EXPRESSION.\n"
+            ));
+      }
       CMD_HELP(
           ("  %s FIRST_ADDR LAST_ADDR\n"
            "Set watchpoints on %s of addresses\n", cmdstr.c_str(), (kind == 'w') ? "write" : (kind == 'r') ? "read" : "access"
           ));
-      incmd >> param2;
+      std::string rest;
+      getline(incmd, rest);
+      std::istringstream inrest(rest);
+      inrest >> param2;
 
       uint16_t first = 0;
       uint16_t last = 0;
       try {
         first = lexical_cast<uint16_t>(param1);
-        last  = lexical_cast<uint16_t>(param2);
+        last  = param2.empty() ? first : lexical_cast<uint16_t>(param2);
       } catch(bad_lexical_cast &e) {
+        if (kind == 'w' && !clear) {
+          Expression *expression = Expression::compile(param1 + rest, src_info, selected_scope, cpu, mem);
+          // the locals are read through R5, the one of the innermost frame
+          if (expression && expression->frame_relative() && session->selected_frame_id > 0) {
+            printf("Can't watch the locals of an outer frame, select frame 0 first.\n");
+            delete expression;
+          } else if (expression) {
+            int id = breakpoints.addWatch(expression, session->call_stack.depth());
+            printf("Watchpoint %d: %s\n", id, expression->text().c_str());
+          }
+          continue;
+        }
         printf("Bad argument for the %s command (Two addresses expected)\nTry using the `help %s' command.\n", cmdstr.c_str(), cmdstr.c_str());
         continue;
       }
@@ -1240,7 +1843,7 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       } else {
 	// add to display
 	VariableInfo* v = find_variable(cpu, mem, src_info, param1.c_str(), selected_scope);
-	if (v) displays.push_back(DisplayInfo(++lastDisplay, v));
+	if (v) session->displays.push_back(DisplayInfo(++session->lastDisplay, v));
       }
     } else if (cmdstr == "print" || cmdstr == "p" || cmdstr == "output") {
       CMD_HELP(
@@ -1273,6 +1876,13 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       if (v) {
 	print_variable(v, cpu, mem, src_info);
       }
+    } else if (cmdstr == "interrupt") {
+      CMD_HELP(
+	  ("  interrupt\n"
+	   "Stop the program running in the background (started by `continue &', `next &'...).\n"
+	   "While it runs only `info registers' and `interrupt' are accepted.\n"
+	  ));
+      printf("The program is not being run.\n");
     } else if (cmdstr == "exit" || cmdstr == "quit" || cmdstr == "q") {
       CMD_HELP(("Quits the debugger.\n"));
       free(cmdline);
@@ -1331,9 +1941,9 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	      printf("No display number %d\n", id);
 	    } else {
 		if (is_delete_cmd) {
-		  displays.erase(displays.begin()+i);
+		  session->displays.erase(session->displays.begin()+i);
 		} else {
-		  displays[i].isActive = 0;
+		  session->displays[i].isActive = 0;
 		}
 	    }
 	  }
@@ -1383,7 +1993,7 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	    if (i == DISPLAY_NOT_FOUND) {
 	      printf("No display number %d\n", id);
 	    } else {
-	      displays[i].isActive = 1;
+	      session->displays[i].isActive = 1;
 	    }
 	  }
 	  param1.clear();
@@ -1399,7 +2009,7 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	}
 
 	update_backtrace(cpu, mem, src_info);
-	int frame_count = backtrace.frames.size();
+	int frame_count = session->backtrace.frames.size();
 
 	if (cmdstr == "frame") {
           CMD_HELP(
@@ -1408,8 +2018,8 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
                "See also:\n"
                "    `help frame`   to select the frame (to use when printing/setting the locals/args)\n"
               ));
-	  //selected_frame = backtrace.frames.begin() + ((N==-1) ? 0 : N);
-	  selected_frame_id = ((N==-1) ? selected_frame_id : N);
+	  //session->selected_frame = session->backtrace.frames.begin() + ((N==-1) ? 0 : N);
+	  session->selected_frame_id = ((N==-1) ? session->selected_frame_id : N);
 	} else if (cmdstr == "up") {
           CMD_HELP(
               ("  up [COUNT]\n"
@@ -1417,9 +2027,9 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
                "See also:\n"
                "    `help frame`   to select the frame (to use when printing/setting the locals/args)\n"
               ));
-	  selected_frame_id += ((N==-1) ? 1 : N);
-	  //selected_frame += (N==-1) ? 1 : N;
-	  //selected_frame = backtrace.frames.begin() + (*selected_frame)->id +((N==-1) ? 1 : N);
+	  session->selected_frame_id += ((N==-1) ? 1 : N);
+	  //session->selected_frame += (N==-1) ? 1 : N;
+	  //session->selected_frame = session->backtrace.frames.begin() + (*session->selected_frame)->id +((N==-1) ? 1 : N);
 	} else if (cmdstr == "down") {
           CMD_HELP(
               ("  down [COUNT]\n"
@@ -1427,22 +2037,22 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
                "See also:\n"
                "    `help frame`   to select the frame (to use when printing/setting the locals/args)\n"
               ));
-	  selected_frame_id -= ((N==-1) ? 1 : N);
-	  //selected_frame = backtrace.frames.begin() + (*selected_frame)->id -((N==-1) ? 1 : N);
-	  //selected_frame -= (N==-1) ? 1 : N;
+	  session->selected_frame_id -= ((N==-1) ? 1 : N);
+	  //session->selected_frame = session->backtrace.frames.begin() + (*session->selected_frame)->id -((N==-1) ? 1 : N);
+	  //session->selected_frame -= (N==-1) ? 1 : N;
 	}
-	if (selected_frame_id >= frame_count) {
-	  selected_frame_id = frame_count-1;
+	if (session->selected_frame_id >= frame_count) {
+	  session->selected_frame_id = frame_count-1;
 	}
-	if (selected_frame_id < 0) {
-	  selected_frame_id = 0;
+	if (session->selected_frame_id < 0) {
+	  session->selected_frame_id = 0;
 	}
-	selected_frame = backtrace.frames.begin() + selected_frame_id;
+	session->selected_frame = session->backtrace.frames.begin() + session->selected_frame_id;
 
-	//if (selected_frame != backtrace.frames.end()) {
+	//if (session->selected_frame != session->backtrace.frames.end()) {
 	if (frame_count) {
-	  print_frame(*selected_frame, cpu, mem, src_info);
-	  selected_scope = (*selected_frame)->scope;
+	  print_frame(*session->selected_frame, cpu, mem, src_info);
+	  selected_scope = (*session->selected_frame)->scope;
 	  show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode, selected_scope);
 	}
 	continue;
@@ -1457,9 +2067,9 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
            "    `help dasm`    for disassembly\n"));
       update_backtrace(cpu, mem, src_info);
 
-      if (backtrace.frames.size() > 1) {
-        for (int i=0; i < backtrace.frames.size(); i++) {
-          print_frame(backtrace.frames[i], cpu, mem, src_info);
+      if (session->backtrace.frames.size() > 1) {
+        for (int i=0; i < session->backtrace.frames.size(); i++) {
+          print_frame(session->backtrace.frames[i], cpu, mem, src_info);
         }
       }
       show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode, selected_scope);
@@ -1488,6 +2098,7 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
            "  info args                 -- arguments of current function\n"
            "  info variables|var        -- global and file-static variables\n"
            "  info registers|r          -- CPU and some special memory mapped registers\n"
+           "  info profile [COUNT]      -- COUNT hottest functions and source lines (default 10)\n"
            "Show various information about the state of the debugged program.\n"
           ));
       if (param1 == "breakpoints" || param1 == "b") {
@@ -1504,6 +2115,19 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       } else if (param1 == "registers" || param1 == "r") {
 	  print_registers(cpu, mem, src_info, "\t","\n");
           printf("\n");
+      } else if (param1 == "profile") {
+	incmd >> param2;
+	int count;
+	try {
+	  count = lexical_cast<uint16_t>(param2);
+	} catch(bad_lexical_cast &e) {
+	  count = 10;
+	}
+	if (session->profiler) {
+	  session->profiler->report(src_info, session->call_stack, stdout, count);
+	} else {
+	  printf("No profile, use `profile on' first\n");
+	}
       }
     } else {
       printf("Bad command `%s'\nTry using the `help' command.\n", cmd);
@@ -1511,86 +2135,27 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
     }
 
     if (instructions_to_run) {
-      while (instructions_to_run) {
-	//fprintf(stderr, "\nIR: %d \tPC: %04x\n", instructions_to_run, cpu.PC & (0xFFFF));
-	instructions_to_run--;
-
-	// Check stoping conditions
-	if (!(mem[0xFFFE] & 0x8000)) {
-	  fprintf(stderr, "LC3 is halted. Set the 0x8000 bit of mem[0xFFFE] to run it again.\n");
-	  break;
-	}
-	// FixMe:
-	if (break_on_return) {
-	  int i = mem[cpu.PC] & (0xFFFF);
-	  if (i == 0xc1c0 || // RET
-	      i == 0x8000)   // RTI
-	  {
-	    fprintf(stderr, "stopped on return\n");
-	    break_on_return = false;
-	    break;
-	  }
-	}
-        if (watchpoint_was_hit) {
-          break;
-        }
-	if (signal_received) {
-	  signal_received = 0;
-	  break;
-	}
-	if (temporary_breakpoint == cpu.PC) {
-	  temporary_breakpoint = -1;
-	  if (!in_step_over_mode) {
-	    break;
-	  } else {
-	    limit_execution_range_start = saved_execution_range_start;
-	    limit_execution_range_end = saved_execution_range_end;
-	    // Reset for next command
-	    step_over_calls = 1;
-	  }
-	}
-	if (!breakpoint_hit && breakpoints.check(cpu.PC)) {
-	  breakpoint_hit = true;
-	  break;
-	}
-
-	// next/nexti workaround
-        // look at the lc3sim for ideas of how to implement this by counting the frames on call/ret
-        // CAlls:  JSR: 0xF800,0x4800;  JSRR:0xFE3F,0x4000;  TRAP:0xFF00,0xF000
-        // Ret: JMP R7 (0xFE3F,0xC1C0), RTI
-	if (step_over_calls) {
-	  uint16_t IR_opcode = mem[cpu.PC] & 0xF000;
-	  if (IR_opcode == 0xF000 || // TRAP
-	      IR_opcode == 0x4000) { // JSR
-	    // Next instruction is a call
-	    in_step_over_mode = 1;
-	    step_over_calls = 0;
-
-	    temporary_breakpoint = cpu.PC + 1;
-
-	    instructions_to_run = INT_INFINITY;
-	    saved_execution_range_start = limit_execution_range_start;
-	    saved_execution_range_end = limit_execution_range_end;
-	    limit_execution_range_start = 0;
-	    limit_execution_range_end = INT_INFINITY;
-	  }
-	}
-
-	// Execute
-	cpu.cycle();
-	mem.cycle();
-	instruction_count++;
-	breakpoint_hit = false;
-
-	if (cpu.PC < limit_execution_range_start ||
-	    cpu.PC > limit_execution_range_end) {
-	  break;
-	}
-
+      job.session = session;
+      job.cpu = &cpu;
+      job.mem = &mem;
+      job.hw = &hw;
+      job.breakpoints = &breakpoints;
+      job.instructions_to_run = instructions_to_run;
+      job.limit_execution_range_start = limit_execution_range_start;
+      job.limit_execution_range_end = limit_execution_range_end;
+      job.step_over_calls = step_over_calls;
+      job.finishing = finishing;
+      job.frame_depth = frame_depth;
+
+      session->runner.take();	// the interrupts typed at the prompt
+      session->runner.start(run_job, &job);
+      if (background) {
+	running_in_background = true;
+      } else {
+	session->runner.wait();
+	selected_scope = cpu.PC;
+	show_stop(cpu, src_info, mem, hw, gui_mode, quiet_mode);
       }
-      // One ore more instructions have been executed. Show the stopped location to the user.
-      selected_scope = cpu.PC;
-      show_execution_position(cpu, src_info, mem, gui_mode, quiet_mode);
     }
 
     repeat_count = 0;
@@ -1598,6 +2163,10 @@ int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
       printf("Bad command `%s'\nTry using the `help' command.\n", cmd);
   }
 
+  // the job uses the breakpoints and the job of this function
+  session->runner.post(RunThread::INTERRUPT);
+  session->runner.wait();
+  __sync_bool_compare_and_swap(&console_runner, &session->runner, (RunThread *)NULL);
   return 0;
 }
 
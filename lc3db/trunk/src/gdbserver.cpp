@@ -0,0 +1,636 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+// GDB Remote Serial Protocol stub, for the front-ends that want to read
+// the registers and the memory in bulk instead of parsing the output of
+// the command line interface.
+//
+// The LC-3 memory is addressed by 16 bit words: the addresses and lengths
+// of the m/M/X/Z packets are in words and the words (like the registers)
+// are sent big endian.  The register numbers are R0-R7 (0-7), PC (8) and
+// PSR (9).  The watchpoints see all the data accesses of the program, the
+// vector table reads of the TRAPs and the stack of the interrupts too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+
+#include "cpu.hpp"
+#include "memory.hpp"
+#include "hardware.hpp"
+#include "source_info.hpp"
+#include "breakpoints.hpp"
+#include "watch_ranges.hpp"
+
+uint16_t load_prog(const char *file, SourceInfo &src_info, Memory &mem, uint16_t *pEntry);
+void set_data_watch(DataWatch *watch);
+
+static const char TARGET_XML[] =
+"<?xml version=\"1.0\"?>\n"
+"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+"<target version=\"1.0\">\n"
+"  <feature name=\"org.lc3.core\">\n"
+"    <reg name=\"r0\" bitsize=\"16\" type=\"int16\" regnum=\"0\"/>\n"
+"    <reg name=\"r1\" bitsize=\"16\" type=\"int16\"/>\n"
+"    <reg name=\"r2\" bitsize=\"16\" type=\"int16\"/>\n"
+"    <reg name=\"r3\" bitsize=\"16\" type=\"int16\"/>\n"
+"    <reg name=\"r4\" bitsize=\"16\" type=\"int16\"/>\n"
+"    <reg name=\"r5\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+"    <reg name=\"r6\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+"    <reg name=\"r7\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+"    <reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+"    <reg name=\"psr\" bitsize=\"16\" type=\"uint16\"/>\n"
+"  </feature>\n"
+"</target>\n";
+
+enum { NUM_REGS = 10, POLL_INSTRUCTIONS = 0x1000 };
+
+class GdbServer
+{
+public:
+  GdbServer(int in, int out, LC3::CPU &cpu, Memory &mem, Hardware &hw, UserBreakpoits &breakpoints) :
+    in(in), out(out), cpu(cpu), mem(mem), hw(hw), breakpoints(breakpoints),
+    no_ack(false), in_length(0), in_pos(0) { }
+
+  void serve();
+
+private:
+  // Transport
+  int get_char();
+  bool interrupt_pending();
+  bool receive(std::string &packet);
+  void send(const std::string &packet);
+
+  // Packets
+  std::string handle(const std::string &packet, bool &resume, bool &step, bool &quit);
+  void set_registers(const char *p);
+  std::string read_registers();
+  std::string read_memory(uint16_t addr, unsigned length);
+  bool write_memory(uint16_t addr, unsigned length, const char *data, bool binary, size_t size);
+  std::string set_point(char type, uint16_t addr, unsigned length, bool insert);
+  std::string query(const std::string &packet);
+  std::string run(bool step);
+
+  uint16_t reg(int n);
+  void set_reg(int n, uint16_t value);
+
+  int in, out;
+  LC3::CPU &cpu;
+  Memory &mem;
+  Hardware &hw;
+  UserBreakpoits &breakpoints;
+  DataWatch watch;
+  bool no_ack;
+  char in_buf[4096];
+  size_t in_length, in_pos;
+};
+
+static const char HEX[] = "0123456789abcdef";
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void put_word(std::string &out, uint16_t word)
+{
+  out += HEX[(word >> 12) & 0xF];
+  out += HEX[(word >> 8) & 0xF];
+  out += HEX[(word >> 4) & 0xF];
+  out += HEX[word & 0xF];
+}
+
+// Hex number up to the first non hex character
+static unsigned long parse_hex(const char *&p)
+{
+  unsigned long value = 0;
+  int d;
+  while ((d = hex_digit(*p)) >= 0) {
+    value = (value << 4) | d;
+    p++;
+  }
+  return value;
+}
+
+int GdbServer::get_char()
+{
+  if (in_pos == in_length) {
+    ssize_t n = read(in, in_buf, sizeof(in_buf));
+    if (n <= 0) {
+      return -1;
+    }
+    in_length = n;
+    in_pos = 0;
+  }
+  return (unsigned char)in_buf[in_pos++];
+}
+
+// Ctrl-C sent by the debugger while the program runs
+bool GdbServer::interrupt_pending()
+{
+  if (in_pos == in_length) {
+    struct pollfd p = { in, POLLIN, 0 };
+    if (poll(&p, 1, 0) <= 0) {
+      return false;
+    }
+  }
+  int c = get_char();
+  if (c == 0x03 || c == -1) {
+    return true;
+  }
+  // something else, a packet can't come before the stop reply
+  return false;
+}
+
+bool GdbServer::receive(std::string &packet)
+{
+  for (;;) {
+    int c;
+    // $packet-data#checksum
+    do {
+      c = get_char();
+      if (c == -1) {
+	return false;
+      }
+    } while (c != '$');
+
+    unsigned char sum = 0;
+    packet.clear();
+    while ((c = get_char()) != '#') {
+      if (c == -1) {
+	return false;
+      }
+      sum += c;
+      packet += (char)c;
+    }
+    int h = hex_digit(get_char());
+    int l = hex_digit(get_char());
+    if (no_ack) {
+      return true;
+    }
+    if (h >= 0 && l >= 0 && ((h << 4) | l) == sum) {
+      write(out, "+", 1);
+      return true;
+    }
+    write(out, "-", 1);
+  }
+}
+
+void GdbServer::send(const std::string &packet)
+{
+  std::string buf = "$";
+  unsigned char sum = 0;
+  for (size_t i = 0; i < packet.size(); i++) {
+    sum += (unsigned char)packet[i];
+  }
+  buf += packet;
+  buf += '#';
+  buf += HEX[sum >> 4];
+  buf += HEX[sum & 0xF];
+
+  for (;;) {
+    write(out, buf.data(), buf.size());
+    if (no_ack) {
+      return;
+    }
+    int c = get_char();
+    if (c != '-') {
+      return;
+    }
+  }
+}
+
+uint16_t GdbServer::reg(int n)
+{
+  if (n < 8) {
+    return cpu.R[n];
+  }
+  return n == 8 ? cpu.PC : cpu.PSR;
+}
+
+void GdbServer::set_reg(int n, uint16_t value)
+{
+  if (n < 8) {
+    cpu.R[n] = value;
+  } else if (n == 8) {
+    cpu.PC = value;
+  } else {
+    cpu.PSR = value;
+  }
+}
+
+void GdbServer::set_registers(const char *p)
+{
+  for (int i = 0; i < NUM_REGS; i++) {
+    uint16_t word = 0;
+    for (int d = 0; d < 4; d++, p++) {
+      if (hex_digit(*p) < 0) {
+	return;
+      }
+      word = (word << 4) | hex_digit(*p);
+    }
+    set_reg(i, word);
+  }
+}
+
+std::string GdbServer::read_registers()
+{
+  std::string out;
+  for (int i = 0; i < NUM_REGS; i++) {
+    put_word(out, reg(i));
+  }
+  return out;
+}
+
+std::string GdbServer::read_memory(uint16_t addr, unsigned length)
+{
+  std::string out;
+  out.reserve(length * 4);
+  for (unsigned i = 0; i < length; i++) {
+    // The device registers are not read, that would consume the input
+    uint16_t a = addr + i;
+    put_word(out, mem.is_mapped(a) ? 0 : (uint16_t)mem[a]);
+  }
+  return out;
+}
+
+bool GdbServer::write_memory(uint16_t addr, unsigned length, const char *data, bool binary, size_t size)
+{
+  size_t pos = 0;
+  for (unsigned i = 0; i < length; i++) {
+    uint16_t word = 0;
+    for (int b = 0; b < 2; b++) {
+      int byte;
+      if (binary) {
+	if (pos >= size) {
+	  return false;
+	}
+	byte = (unsigned char)data[pos++];
+	if (byte == 0x7d) {
+	  if (pos >= size) {
+	    return false;
+	  }
+	  byte = (unsigned char)data[pos++] ^ 0x20;
+	}
+      } else {
+	if (pos + 2 > size) {
+	  return false;
+	}
+	int h = hex_digit(data[pos]), l = hex_digit(data[pos + 1]);
+	if (h < 0 || l < 0) {
+	  return false;
+	}
+	byte = (h << 4) | l;
+	pos += 2;
+      }
+      word = (word << 8) | byte;
+    }
+    mem[(uint16_t)(addr + i)] = word;
+  }
+  return true;
+}
+
+std::string GdbServer::set_point(char type, uint16_t addr, unsigned length, bool insert)
+{
+  uint16_t last = addr + (length ? length - 1 : 0);
+  switch (type) {
+  case '0':
+  case '1':
+    if (insert) {
+      breakpoints.add(addr, false);
+    } else {
+      int id = breakpoints.find(addr);
+      if (!id) {
+	return "E01";
+      }
+      breakpoints.erase(id);
+    }
+    return "OK";
+  case '2':
+  case '3':
+  case '4':
+    {
+      WatchRanges &ranges = (type == '2') ? watch.write : (type == '3') ? watch.read : watch.access;
+      if (insert) {
+	ranges.add(addr, last);
+      } else {
+	ranges.remove(addr, last);
+      }
+    }
+    return "OK";
+  }
+  return "";
+}
+
+// Answer to the qXfer reads: 'm' and a chunk or 'l' and the last chunk
+static std::string xfer_chunk(const char *data, size_t size, const char *p)
+{
+  unsigned long offset = parse_hex(p);
+  if (*p++ != ',') {
+    return "E01";
+  }
+  unsigned long length = parse_hex(p);
+  if (offset > size) {
+    return "E01";
+  }
+  std::string out = (offset + length >= size) ? "l" : "m";
+  for (size_t i = offset; i < size && i < offset + length; i++) {
+    char c = data[i];
+    if (c == '$' || c == '#' || c == '}' || c == '*') {
+      out += '}';
+      c ^= 0x20;
+    }
+    out += c;
+  }
+  return out;
+}
+
+std::string GdbServer::query(const std::string &packet)
+{
+  if (packet.compare(0, 10, "qSupported") == 0) {
+    return "PacketSize=4000;qXfer:features:read+;QStartNoAckMode+;vContSupported+";
+  }
+  if (packet.compare(0, 31, "qXfer:features:read:target.xml:") == 0) {
+    return xfer_chunk(TARGET_XML, sizeof(TARGET_XML) - 1, packet.c_str() + 31);
+  }
+  if (packet == "QStartNoAckMode") {
+    return "OK";
+  }
+  if (packet == "qAttached") {
+    return "1";
+  }
+  if (packet == "qC") {
+    return "QC1";
+  }
+  if (packet == "qfThreadInfo") {
+    return "m1";
+  }
+  if (packet == "qsThreadInfo") {
+    return "l";
+  }
+  return "";
+}
+
+// Runs until a breakpoint, a watchpoint, the halt or the interrupt from
+// the debugger and returns the stop reply
+std::string GdbServer::run(bool step)
+{
+  unsigned long count = 0;
+
+  // the memory accesses are watched by mem_read() and mem_write()
+  watch.hit = NULL;
+  set_data_watch(watch.empty() ? NULL : &watch);
+
+  for (;;) {
+    if (!(mem[0xFFFE] & 0x8000)) {
+      hw.flush();
+      return "W00";
+    }
+
+    cpu.cycle();
+    mem.cycle();
+
+    if (watch.hit) {
+      char reply[32];
+      hw.flush();
+      sprintf(reply, "T05%s:%04x;", watch.hit, watch.address);
+      return reply;
+    }
+    if (step || breakpoints.check(cpu.PC)) {
+      hw.flush();
+      return "S05";
+    }
+    if (++count % POLL_INSTRUCTIONS == 0 && interrupt_pending()) {
+      hw.flush();
+      return "S02";
+    }
+  }
+}
+
+std::string GdbServer::handle(const std::string &packet, bool &resume, bool &step, bool &quit)
+{
+  const char *p = packet.c_str() + 1;
+
+  switch (packet.empty() ? 0 : packet[0]) {
+  case '?':
+    return "S05";
+  case 'g':
+    return read_registers();
+  case 'G':
+    set_registers(p);
+    return "OK";
+  case 'p':
+    {
+      unsigned long n = parse_hex(p);
+      if (n >= NUM_REGS) {
+	return "E01";
+      }
+      std::string out;
+      put_word(out, reg(n));
+      return out;
+    }
+  case 'P':
+    {
+      unsigned long n = parse_hex(p);
+      if (n >= NUM_REGS || *p++ != '=') {
+	return "E01";
+      }
+      set_reg(n, parse_hex(p));
+      return "OK";
+    }
+  case 'm':
+  case 'M':
+  case 'X':
+    {
+      uint16_t addr = parse_hex(p);
+      if (*p++ != ',') {
+	return "E01";
+      }
+      unsigned long length = parse_hex(p);
+      if (packet[0] == 'm') {
+	return read_memory(addr, length > 0x10000 ? 0x10000 : length);
+      }
+      if (*p++ != ':') {
+	return "E01";
+      }
+      size_t size = packet.size() - (p - packet.c_str());
+      return write_memory(addr, length, p, packet[0] == 'X', size) ? "OK" : "E01";
+    }
+  case 'Z':
+  case 'z':
+    {
+      char type = *p++;
+      if (*p++ != ',') {
+	return "E01";
+      }
+      uint16_t addr = parse_hex(p);
+      unsigned long length = (*p == ',') ? parse_hex(++p) : 1;
+      return set_point(type, addr, length, packet[0] == 'Z');
+    }
+  case 'c':
+  case 's':
+    if (*p) {
+      cpu.PC = parse_hex(p);
+    }
+    resume = true;
+    step = (packet[0] == 's');
+    return std::string();
+  case 'v':
+    if (packet == "vCont?") {
+      return "vCont;c;C;s;S";
+    }
+    if (packet.compare(0, 6, "vCont;") == 0) {
+      // single thread: the first action applies
+      resume = true;
+      step = (packet[6] == 's' || packet[6] == 'S');
+      return std::string();
+    }
+    return "";
+  case 'H':
+    return "OK";
+  case 'T':
+    return "OK";
+  case 'D':
+    quit = true;
+    return "OK";
+  case 'k':
+    quit = true;
+    return std::string();
+  case 'q':
+  case 'Q':
+    return query(packet);
+  }
+  return "";
+}
+
+void GdbServer::serve()
+{
+  std::string packet;
+
+  while (receive(packet)) {
+    bool resume = false, step = false, quit = false;
+    std::string reply = handle(packet, resume, step, quit);
+    if (resume) {
+      reply = run(step);
+      set_data_watch(NULL);
+    }
+    if (quit) {
+      // no reply to the kill request
+      if (packet[0] == 'D') {
+	send(reply);
+      }
+      break;
+    }
+    send(reply);
+    if (packet == "QStartNoAckMode") {
+      // the acknowledgement of this reply is the last one
+      no_ack = true;
+    }
+  }
+}
+
+// Connection to the debugger: a TCP port number, "-" for stdin/stdout or
+// a file (a pipe or a serial line).  With stdin/stdout the output of the
+// simulator goes to stderr.
+bool gdbserver_open(const char *spec, int &in, int &out)
+{
+  char *end;
+  long port = strtol(spec, &end, 10);
+
+  if (strcmp(spec, "-") == 0) {
+    in = dup(fileno(stdin));
+    out = dup(fileno(stdout));
+    dup2(fileno(stderr), fileno(stdout));
+    int null = open("/dev/null", O_RDONLY);
+    dup2(null, fileno(stdin));
+    close(null);
+    return in != -1 && out != -1;
+  }
+
+  if (*end == 0 && port > 0 && port < 0x10000) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (s == -1 || bind(s, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(s, 1) == -1) {
+      perror("gdbserver");
+      return false;
+    }
+    fprintf(stderr, "Listening on port %ld\n", port);
+    in = out = accept(s, NULL, NULL);
+    close(s);
+    if (in == -1) {
+      perror("gdbserver");
+      return false;
+    }
+    setsockopt(in, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return true;
+  }
+
+  in = out = open(spec, O_RDWR);
+  if (in == -1) {
+    perror(spec);
+    return false;
+  }
+  return true;
+}
+
+int gdbserver_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
+		   const char *exec_file, int in, int out)
+{
+  UserBreakpoits breakpoints(src_info);
+
+  if (exec_file) {
+    uint16_t start_addr = load_prog(exec_file, src_info, mem, NULL);
+    if (0xFFFF == start_addr) {
+      fprintf(stderr, "failed to load %s\n", exec_file);
+      return 1;
+    }
+    mem[0x01FE] = start_addr;
+  }
+  // stopped at the start of the OS, as after `run'
+  cpu.PC = mem[0x01FF];
+  cpu.PSR = 0x0000;
+  mem[0xFFFE] = mem[0xFFFE] | 0x8000;
+
+  GdbServer(in, out, cpu, mem, hw, breakpoints).serve();
+  hw.flush();
+  close(in);
+  if (out != in) {
+    close(out);
+  }
+  return 0;
+}
+
+// vim: sw=2 si:
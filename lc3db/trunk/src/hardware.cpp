@@ -22,10 +22,12 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "cpu.hpp"
 #include "memory.hpp"
 #include "hardware.hpp"
 
+extern int16_t mem_read(Memory &mem, uint16_t addr);
 
 static int data_available (int fd)
 {
@@ -44,47 +46,156 @@ static int data_available (int fd)
 
 }
 
-struct KBSR : public MappedWord
+// Keyboard of the LC-3, buffered in a ring.  A reader thread fills it from
+// a dedicated terminal or file, so polling KBSR is only a memory load.  The
+// stdin shared with the debugger commands is polled instead, one key at a
+// time, not to steal the commands typed ahead (see KBSR).
+class ConsoleInput
 {
-  enum { ADDRESS = 0xFE00 };
-  KBSR() {
-    fd = fileno(stdin);
-  }
-  operator int16_t() const {
-    return data_available(fd) ? 0x8000 : 0;
+public:
+  ConsoleInput() : fd(fileno(stdin)), head(0), tail(0), reader_running(false) { }
+  ~ConsoleInput() {
+    stop_reader();
   }
 
-  void set_tty(int _fd) {
+  // shared: the fd is the stdin of the debugger commands too
+  void set_tty(int _fd, bool shared) {
+    stop_reader();
     fd = _fd;
+    head = tail = 0;
+    if (!shared &&
+	pthread_create(&reader, NULL, run_reader, this) == 0) {
+      reader_running = true;
+    }
+  }
+
+  // Without a reader thread, the input is polled
+  bool polled() const {
+    return !reader_running;
+  }
+
+  // Reads a key if one is waiting and none is buffered
+  void poll() {
+    if (head == tail && !reader_running && data_available(fd)) {
+      unsigned char c;
+      if (read(fd, &c, 1) == 1) {
+	push(c);
+      }
+    }
+  }
+
+  bool available() const {
+    return head != tail;
+  }
+
+  unsigned char get() {
+    unsigned char c = buf[tail % SIZE];
+    __sync_synchronize();
+    tail++;
+    return c;
   }
 
 private:
+  enum { SIZE = 4096 };
+
+  // Only the reader thread (or poll() without one) pushes
+  void push(unsigned char c) {
+    buf[head % SIZE] = c;
+    __sync_synchronize();
+    head++;
+  }
+
+  static void *run_reader(void *arg) {
+    ConsoleInput *in = (ConsoleInput *)arg;
+    unsigned char chunk[64];
+    ssize_t n;
+
+    while ((n = read(in->fd, chunk, sizeof(chunk))) > 0) {
+      for (ssize_t i = 0; i < n; i++) {
+	// Full, wait for the program to read
+	while (in->head - in->tail == SIZE) {
+	  usleep(1000);
+	}
+	in->push(chunk[i]);
+      }
+    }
+    return NULL;
+  }
+
+  void stop_reader() {
+    if (reader_running) {
+      // blocked in read() or usleep(), both are cancellation points
+      pthread_cancel(reader);
+      pthread_join(reader, NULL);
+      reader_running = false;
+    }
+  }
+
   int fd;
+  unsigned char buf[SIZE];
+  volatile unsigned head;	// written by the reader
+  volatile unsigned tail;	// written by the simulator
+  pthread_t reader;
+  bool reader_running;
+};
+
+// A polled input is polled by the first read of KBSR without a key, then
+// not before POLL_CYCLES instructions: the reads in between, as the loop
+// of GETC waiting for a key, are only memory loads.
+struct KBSR : public MappedWord
+{
+  enum { ADDRESS = 0xFE00, POLL_CYCLES = 1000 };
+  KBSR(Memory &mem, ConsoleInput &input) : mem(mem), input(input), waiting(false) { }
+  operator int16_t() const {
+    return const_cast<KBSR *>(this)->ready() ? 0x8000 : 0;
+  }
+
+  bool ready() {
+    if (!input.available() && input.polled() && !waiting) {
+      input.poll();
+      if (!input.available()) {
+	waiting = true;
+	mem.schedule(this, mem.cycles() + POLL_CYCLES);
+      }
+    }
+    return input.available();
+  }
+
+  void cycle() {
+    waiting = false;
+  }
+
+  // The event may be gone with a restored memory
+  void reset() {
+    mem.cancel(this);
+    waiting = false;
+  }
+
+private:
+  Memory &mem;
+  ConsoleInput &input;
+  bool waiting;		// for the next poll
 };
 
 struct KBDR : public MappedWord
 {
   enum { ADDRESS = 0xFE02 };
-  KBDR() {
-    fd = fileno(stdin);
-  }
+  KBDR(ConsoleInput &input) : input(input), prev_char(0) { }
 
   operator int16_t() const {
-    static unsigned char prev_char;
     // Note: terminal is setup in Hardware class
-    if (data_available(fd)) {
-      int ret = read(fd,&prev_char, 1);
- //     printf("read(%d): %d = %d\n", fd, ret, prev_char);
+    if (input.available()) {
+      prev_char = input.get();
     }
     return prev_char;
   }
 
-  void set_tty(int _fd) {
-    fd = _fd;
-  }
+  unsigned char last_key() const { return prev_char; }
+  void set_last_key(unsigned char c) { prev_char = c; }
 
 private:
-  int fd;
+  ConsoleInput &input;
+  mutable unsigned char prev_char;
 };
 
 struct DSR : public MappedWord
@@ -93,66 +204,147 @@ struct DSR : public MappedWord
   operator int16_t() const { return 0x8000; }
 };
 
+// Display, buffered unless strict output is requested.  The buffer is
+// written on a newline, when full, when the simulation stops and after
+// IDLE_CYCLES instructions without output.  A single event is pending
+// while the buffer is not empty, moved on when it finds recent output.
 struct DDR : public MappedWord
 {
-  enum { ADDRESS = 0xFE06 };
-  DDR() : fd(-1) { }
+  enum { ADDRESS = 0xFE06, IDLE_CYCLES = 10000 };
+  DDR(Memory &mem) : mem(mem), fd(-1), buffered(true), length(0), last_output(0) { }
   DDR &operator=(int16_t data) {
+    buf[length++] = data & 0xFF;
+    last_output = mem.cycles();
+    if (!buffered || (data & 0xFF) == '\n' || length == sizeof(buf)) {
+      flush();
+    } else if (length == 1) {
+      mem.schedule(this, last_output + IDLE_CYCLES);
+    }
+    return *this;
+  }
+
+  void cycle() {
+    if (mem.cycles() - last_output < IDLE_CYCLES) {
+      mem.schedule(this, last_output + IDLE_CYCLES);
+    } else {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (length == 0) {
+      return;
+    }
     if (fd == -1) {
-      putchar(data & 0xFF);
+      fwrite(buf, 1, length, stdout);
       fflush(stdout);
     } else {
-      int8_t byte = data & 0xFF;
-      write(fd, &byte, 1);
+      write(fd, buf, length);
+    }
+    length = 0;
+    mem.cancel(this);
+  }
+
+  void set_buffered(bool _buffered) {
+    buffered = _buffered;
+    if (!buffered) {
+      flush();
     }
-    return *this;
   }
 
   void set_tty(int _fd) {
+    flush();
     fd = _fd;
   }
 
 private:
+  Memory &mem;
   int fd;
+  bool buffered;
+  size_t length;
+  uint64_t last_output;	// cycle of the last character buffered
+  char buf[1024];
 };
 
+// The counter is not ticked, its value follows from the cycle count of
+// the memory at the time it was last written
 struct CCR : public MappedWord
 {
   enum { ADDRESS = 0xFFFF };
-  CCR() : ccr(0) { }
-  operator int16_t() const { return (int16_t)ccr; }
-  operator uint16_t() const { return ccr; }
+  CCR(Memory &mem) : mem(mem), ccr(0), written(0), timer(0) { }
+  operator int16_t() const { return (int16_t)(uint16_t)*this; }
+  operator uint16_t() const { return ccr + (uint16_t)(mem.cycles() - written); }
   CCR &operator=(int16_t value) {
     ccr = (uint16_t)value;
+    written = mem.cycles();
+    if (timer) {
+      // the time of the timer interrupt has moved
+      mem.schedule(timer, mem.cycles() + 1);
+    }
     return *this;
   }
-  void mycycle() {
-    ccr++;
+  void set_timer(MappedWord *_timer) {
+    timer = _timer;
+  }
+
+  // Raw state, the restored memory already has the timer event
+  void save(uint16_t &_ccr, uint64_t &_written) const {
+    _ccr = ccr;
+    _written = written;
+  }
+  void restore(uint16_t _ccr, uint64_t _written) {
+    ccr = _ccr;
+    written = _written;
   }
 private:
+  Memory &mem;
   uint16_t ccr;
+  uint64_t written;
+  MappedWord *timer;
 };
 
+// Raises the timer interrupt for as long as the enabled limit is reached,
+// the cycles in between are skipped by scheduling the next check
 struct MCR : public MappedWord
 {
-  MCR(CCR &ccr, LC3::CPU &cpu) : mcr(0x0030), ccr(ccr), cpu(cpu) { }
+  MCR(Memory &mem, CCR &ccr, LC3::CPU &cpu) :
+    mcr(0x0030), mem(mem), ccr(ccr), cpu(cpu)
+  {
+    ccr.set_timer(this);
+  }
 
   enum { ADDRESS = 0xFFFE };
   operator int16_t() const { return mcr; }
   MCR &operator=(int16_t value) {
     mcr = value;
+    mem.schedule(this, mem.cycles() + 1);
     return *this;
   }
 
+  bool halted() const {
+    return !(mcr & 0x8000);
+  }
+
+  int16_t value() const { return mcr; }
+  void restore(int16_t value) {
+    mcr = value;
+  }
+
   void cycle() {
-    ccr.mycycle();
-    if ((uint16_t)ccr >= (mcr & 0x3FFF) && 
-	mcr & 0x4000) {
+    if (!(mcr & 0x4000)) {
+      return;
+    }
+    uint16_t limit = mcr & 0x3FFF;
+    if ((uint16_t)ccr >= limit) {
       cpu.interrupt(0x02, 1);
+      mem.schedule(this, mem.cycles() + 1);
+    } else {
+      mem.schedule(this, mem.cycles() + (uint16_t)(limit - (uint16_t)ccr));
     }
   }
 private:
   int16_t mcr;
+  Memory &mem;
   CCR &ccr;
   LC3::CPU &cpu;
 };
@@ -179,11 +371,18 @@ private:
 };
 #endif
 
-class Hardware::Implementation
+// Condition codes of value, as set by the instruction loading it
+static void set_cc(LC3::CPU &cpu, int16_t value)
+{
+  cpu.PSR = (cpu.PSR & 0xFFF8) | ((value < 0) ? 4 : (value ? 1 : 2));
+}
+
+class Hardware::Implementation : private LC3::TrapHandler
 {
 public:
   Implementation(Memory &mem, LC3::CPU &cpu) : 
-    mem(mem), mcr(ccr, cpu), ifd(-1), ofd(-1)
+    mem(mem), cpu(cpu), kbsr(mem, console), kbdr(console), ddr(mem), ccr(mem), mcr(mem, ccr, cpu),
+    ifd(-1), ofd(-1), os_traps_recorded(false)
   {
     mem.register_dma(KBSR::ADDRESS, &kbsr);
     mem.register_dma(KBDR::ADDRESS, &kbdr);
@@ -207,27 +406,66 @@ public:
 #endif
 
     // Set the terminal to non-echo mode
-    set_tty(fileno(stdin), fileno(stdout));
+    set_tty(fileno(stdin), fileno(stdout), false);
 
   }
   ~Implementation() {
+    ddr.flush();
     if (ifd != -1) {
       // restore previous settings
       tcsetattr(ifd, TCSANOW, &termios_original);
     }
   }
 
-  void set_tty(int _ifd, int _ofd) {
+  void set_tty(int _ifd, int _ofd, bool exclusive) {
     setup_input_tty(_ifd);
-    kbsr.set_tty(_ifd);
-    kbdr.set_tty(_ifd);
+    console.set_tty(_ifd, _ifd == fileno(stdin) && !exclusive);
 
     ddr.set_tty(_ofd);
     ofd = _ofd;
   }
 
   void set_tty(int fd) {
-    set_tty(fd, fd);
+    set_tty(fd, fd, false);
+  }
+
+  void flush() {
+    ddr.flush();
+  }
+
+  bool halted() const {
+    return mcr.halted();
+  }
+
+  void set_buffered_output(bool buffered) {
+    ddr.set_buffered(buffered);
+  }
+
+  void set_native_traps(bool native) {
+    cpu.set_trap_handler(native ? this : NULL);
+  }
+
+  void record_os_traps() {
+    for (int i = 0; i < 5; i++) {
+      os_trap[i] = mem.read(0x20 + i);
+    }
+    os_traps_recorded = true;
+  }
+
+  void save(Hardware::State &state) {
+    // the output since then is not taken back, only keep it in order
+    ddr.flush();
+    state.mcr = mcr.value();
+    ccr.save(state.ccr, state.ccr_written);
+    state.last_key = kbdr.last_key();
+  }
+
+  void restore(const Hardware::State &state) {
+    ddr.flush();
+    mcr.restore(state.mcr);
+    ccr.restore(state.ccr, state.ccr_written);
+    kbdr.set_last_key(state.last_key);
+    kbsr.reset();
   }
   
   void setup_input_tty(int fd) {
@@ -248,16 +486,79 @@ public:
 
 
 private:
+  // The console TRAPs of los.asm, leaving the registers and the condition
+  // codes as its routines do.  PUTSP, an error message in los.asm, is left
+  // to it, and so are GETC and IN without a key typed, the routine of the
+  // OS waits for it.  The routines call each other (PUTS calls
+  // OUT...), so once the program points any of the vectors to its own
+  // routine, all of them go to the routines.
+  bool trap(LC3::CPU &cpu, uint16_t vector) {
+    if (!os_traps_recorded) {
+      return false;
+    }
+    for (int i = 0; i < 5; i++) {
+      if (mem.read(0x20 + i) != os_trap[i]) {
+	return false;
+      }
+    }
+    switch (vector) {
+    case 0x20:	// GETC
+      if (!kbsr.ready()) {
+	return false;
+      }
+      cpu.R[0] = kbdr;
+      set_cc(cpu, cpu.R[0]);
+      return true;
+    case 0x21:	// OUT
+      ddr = cpu.R[0];
+      set_cc(cpu, cpu.R[1]);
+      return true;
+    case 0x22:	// PUTS
+      write_string(cpu.R[0]);
+      set_cc(cpu, cpu.R[7]);
+      return true;
+    case 0x23:	// IN
+      if (!kbsr.ready()) {
+	return false;
+      }
+      for (const char *p = "Enter a character: "; *p; p++) {
+	ddr = *p;
+      }
+      cpu.R[0] = kbdr;
+      ddr = cpu.R[0];
+      ddr = '\n';
+      set_cc(cpu, cpu.R[7]);
+      return true;
+    }
+    return false;
+  }
+
+  // Writes the string at address up to the 0 word
+  void write_string(uint16_t address) {
+    for (int n = 0; n < 0x10000; n++, address++) {
+      uint16_t word = mem_read(mem, address);
+      if (word == 0) {
+	return;
+      }
+      ddr = word;
+    }
+  }
+
   int ifd;
   int ofd;
   struct termios termios_original;
   Memory &mem;
+  LC3::CPU &cpu;
+  ConsoleInput console;
   KBSR kbsr;
   KBDR kbdr;
   DSR dsr;
   DDR ddr;
   CCR ccr;
   MCR mcr;
+  // vector table entries x20-x24 of the OS, see record_os_traps()
+  int16_t os_trap[5];
+  bool os_traps_recorded;
 };
 
 Hardware::Hardware(Memory &mem, LC3::CPU &cpu) :
@@ -274,3 +575,43 @@ void Hardware::set_tty(int fd)
 {
   impl->set_tty(fd);
 }
+
+void Hardware::set_tty(int ifd, int ofd, bool exclusive)
+{
+  impl->set_tty(ifd, ofd, exclusive);
+}
+
+bool Hardware::halted()
+{
+  return impl->halted();
+}
+
+void Hardware::flush()
+{
+  impl->flush();
+}
+
+void Hardware::set_buffered_output(bool buffered)
+{
+  impl->set_buffered_output(buffered);
+}
+
+void Hardware::set_native_traps(bool native)
+{
+  impl->set_native_traps(native);
+}
+
+void Hardware::record_os_traps()
+{
+  impl->record_os_traps();
+}
+
+void Hardware::save(State &state)
+{
+  impl->save(state);
+}
+
+void Hardware::restore(const State &state)
+{
+  impl->restore(state);
+}
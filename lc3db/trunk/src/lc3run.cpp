@@ -0,0 +1,488 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *  Modifications 2010  Edgar Lakis <edgar.lakis@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * vim: sw=2 si:
+\*/
+
+// Batch runner: loads the OS and the program, then runs it until HALT
+// without any of the debugger checks between the instructions.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "cpu.hpp"
+#include "memory.hpp"
+#include "hardware.hpp"
+#include "checkpoint.hpp"
+#include "source_info.hpp"
+#include "coverage.hpp"
+
+uint16_t load_prog(const char *file, SourceInfo &src_info, Memory &mem, uint16_t *entry);
+
+// No watchpoints or tracing here
+int16_t mem_read(Memory &mem, uint16_t addr)
+{
+  return mem[addr];
+}
+
+void mem_write(Memory &mem, uint16_t addr, int16_t value)
+{
+  mem[addr] = value;
+}
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static const char *root;
+
+// Coverage summed over the runs, written on exit (NULL if not asked for)
+static CoverageReport *coverage_report = NULL;
+static pthread_mutex_t coverage_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The console TRAPs are done by the simulator, see Hardware::set_native_traps()
+static bool native_traps = false;
+
+// Runs the loaded program from the OS start until HALT or until the
+// limit, returns the count of executed instructions.  The executed
+// addresses are marked in coverage, if given.
+static unsigned long long run(Memory &mem, LC3::CPU &cpu, Hardware &hw,
+			      unsigned long long max_instructions, Coverage *coverage)
+{
+  cpu.PC = mem[0x01FF];
+  cpu.PSR = 0x0000;
+  mem[0xFFFE] = mem[0xFFFE] | 0x8000;
+
+  unsigned long long count = 0;
+  if (coverage) {
+    while (count < max_instructions && !hw.halted()) {
+      uint16_t pc = cpu.PC;
+      cpu.cycle();
+      coverage->executed(pc, cpu.PC);
+      mem.cycle();
+      count++;
+    }
+  } else {
+    while (count < max_instructions && !hw.halted()) {
+      cpu.cycle();
+      mem.cycle();
+      count++;
+    }
+  }
+  hw.flush();
+  return count;
+}
+
+/* Batch mode: every line of the manifest is a job
+ *   OBJECT_FILE INPUT_FILE EXPECTED_OUTPUT [MAX_INSTRUCTIONS]
+ * where "-" stands for no input or no check of the output.  The jobs run
+ * in parallel, each worker with its own machine.  The OS is loaded once per
+ * worker and its state restored before every job.  The output of the
+ * program goes to OBJECT.out and the outcome to OBJECT.result.
+ */
+struct Job
+{
+  std::string object;
+  std::string input;
+  std::string expected;
+  unsigned long long max_instructions;
+  bool passed;
+};
+
+static std::vector<Job> jobs;
+static size_t next_job = 0;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool same_content(const char *file1, const char *file2)
+{
+  FILE *f1 = fopen(file1, "rb");
+  FILE *f2 = fopen(file2, "rb");
+  bool same = f1 && f2;
+  while (same) {
+    int c = getc(f1);
+    same = (c == getc(f2));
+    if (c == EOF) {
+      break;
+    }
+  }
+  if (f1) {
+    fclose(f1);
+  }
+  if (f2) {
+    fclose(f2);
+  }
+  return same;
+}
+
+// Machine of a worker, rewound to the loaded OS for each job
+struct Machine
+{
+  Machine() : cpu(mem), hw(mem, cpu), booted(NULL) {
+    hw.set_native_traps(native_traps);
+  }
+  ~Machine() {
+    delete booted;
+  }
+
+  // No debug information is needed, so Memory::load() instead of the
+  // chatty load_prog()
+  bool boot() {
+    char los[2048];
+    sprintf(los, "%s/lib/lc3db/los.obj", root);
+    if (0xFFFF == mem.load("lib/los.obj") && 0xFFFF == mem.load(los)) {
+      return false;
+    }
+    hw.record_os_traps();
+    booted = new Checkpoint(cpu, mem, hw);
+    return true;
+  }
+
+  Memory mem;
+  LC3::CPU cpu;
+  Hardware hw;
+  Checkpoint *booted;
+  Coverage coverage;
+};
+
+static void run_job(Machine &machine, Job &job)
+{
+  std::string base = job.object.substr(0, job.object.rfind(".obj"));
+  std::string output = base + ".out";
+  std::string result = base + ".result";
+  const char *status = NULL;
+  const char *check = "not checked";
+  unsigned long long count = 0;
+  Memory &mem = machine.mem;
+  SourceInfo src_info;
+  Coverage *coverage = coverage_report ? &machine.coverage : NULL;
+
+  job.passed = false;
+
+  if (!machine.booted) {
+    status = "error: could not find los.obj";
+  } else {
+    machine.booted->restore();
+    // the coverage is reported for the lines of the program
+    uint16_t start_addr = coverage ? load_prog(job.object.c_str(), src_info, mem, NULL)
+				   : mem.load(job.object);
+    if (0xFFFF == start_addr) {
+      status = "error: failed to load the object file";
+    } else {
+      mem[0x01FE] = start_addr;
+    }
+  }
+
+  if (!status) {
+    int ifd = open(job.input == "-" ? "/dev/null" : job.input.c_str(), O_RDONLY);
+    int ofd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (ifd == -1 || ofd == -1) {
+      status = ifd == -1 ? "error: could not open the input" : "error: could not create the output";
+    } else {
+      machine.hw.set_tty(ifd, ofd);
+      if (coverage) {
+	coverage->reset();
+      }
+      count = run(mem, machine.cpu, machine.hw, job.max_instructions, coverage);
+      if (coverage) {
+	pthread_mutex_lock(&coverage_lock);
+	coverage_report->add(*coverage, src_info, mem);
+	pthread_mutex_unlock(&coverage_lock);
+      }
+      status = machine.hw.halted() ? "halted" : "instruction limit reached";
+      // stops reading the input before it is closed
+      machine.hw.set_tty(fileno(stdin), fileno(stdout));
+    }
+    if (ofd != -1) {
+      close(ofd);
+    }
+    if (ifd != -1) {
+      close(ifd);
+    }
+    job.passed = (strcmp(status, "halted") == 0);
+    if (job.expected != "-" && ifd != -1 && ofd != -1) {
+      bool same = same_content(output.c_str(), job.expected.c_str());
+      check = same ? "pass" : "fail";
+      job.passed = job.passed && same;
+    }
+  }
+
+  FILE *f = fopen(result.c_str(), "w");
+  if (f) {
+    fprintf(f, "object: %s\n"
+	       "status: %s\n"
+	       "instructions: %llu\n"
+	       "output: %s\n",
+	    job.object.c_str(), status, count, check);
+    fclose(f);
+  } else {
+    perror(result.c_str());
+  }
+}
+
+static void *worker(void *)
+{
+  Machine machine;
+  machine.boot();
+  for (;;) {
+    pthread_mutex_lock(&jobs_lock);
+    size_t i = next_job++;
+    pthread_mutex_unlock(&jobs_lock);
+    if (i >= jobs.size()) {
+      return NULL;
+    }
+    run_job(machine, jobs[i]);
+  }
+}
+
+static int run_batch(const char *manifest, int threads,
+		     unsigned long long max_instructions, bool quiet)
+{
+  FILE *f = fopen(manifest, "r");
+  char line[4096];
+  int line_no = 0;
+
+  if (!f) {
+    perror(manifest);
+    return 1;
+  }
+  while (fgets(line, sizeof(line), f)) {
+    char object[1024], input[1024], expected[1024];
+    unsigned long long max;
+    line_no++;
+    if (line[0] == '#') {
+      continue;
+    }
+    int n = sscanf(line, "%1023s %1023s %1023s %llu", object, input, expected, &max);
+    if (n <= 0) {
+      continue;
+    }
+    if (n < 3) {
+      fprintf(stderr, "%s:%d: expected OBJECT_FILE INPUT_FILE EXPECTED_OUTPUT [MAX_INSTRUCTIONS]\n",
+	      manifest, line_no);
+      continue;
+    }
+    Job job;
+    job.object = object;
+    job.input = input;
+    job.expected = expected;
+    job.max_instructions = (n == 4) ? max : max_instructions;
+    job.passed = false;
+    jobs.push_back(job);
+  }
+  fclose(f);
+
+  double started = now();
+  std::vector<pthread_t> pool;
+  for (int i = 0; i < threads && i < (int)jobs.size(); i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker, NULL) == 0) {
+      pool.push_back(thread);
+    }
+  }
+  if (pool.empty()) {
+    worker(NULL);
+  }
+  for (size_t i = 0; i < pool.size(); i++) {
+    pthread_join(pool[i], NULL);
+  }
+
+  int passed = 0;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    passed += jobs[i].passed;
+  }
+  if (!quiet) {
+    fprintf(stderr, "%d of %d jobs passed, %.3f s with %d threads\n",
+	    passed, (int)jobs.size(), now() - started, (int)pool.size());
+  }
+  return passed == (int)jobs.size() ? 0 : 2;
+}
+
+static bool write_coverage(const char *file_name)
+{
+  if (coverage_report && !coverage_report->write(file_name, "lc3run")) {
+    perror(file_name);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  struct option longopts[] = {
+    {"input"   , 1, 0, 'i'},
+    {"output"  , 1, 0, 'o'},
+    {"max"     , 1, 0, 'n'},
+    {"rootdir" , 1, 0, 'r'},
+    {"quiet"   , 0, 0, 'q'},
+    {"batch"   , 1, 0, 'b'},
+    {"jobs"    , 1, 0, 'j'},
+    {"coverage", 1, 0, 'c'},
+    {"native-traps", 0, 0, 't'},
+    {"help"    , 0, 0, 'h'},
+    {NULL      , 0, 0, 0}
+  };
+  const char *input = NULL;
+  const char *manifest = NULL;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *output = NULL;
+  const char *coverage_file = NULL;
+  unsigned long long max_instructions = 100000000ULL;
+  bool quiet = false;
+  char los[2048];
+  int ch;
+
+  root = getenv("LC3DB_ROOT");
+  if (root == NULL) {
+    root = PREFIX;
+  }
+
+  while (-1 != (ch = getopt_long(argc, argv, "i:o:n:r:qb:j:c:th", longopts, NULL))) {
+    switch (ch) {
+    case 'i':
+      input = optarg;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'n':
+      max_instructions = strtoull(optarg, NULL, 0);
+      break;
+    case 'r':
+      root = optarg;
+      break;
+    case 'q':
+      quiet = true;
+      break;
+    case 'b':
+      manifest = optarg;
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'c':
+      coverage_file = optarg;
+      break;
+    case 't':
+      native_traps = true;
+      break;
+    case 'h':
+    default:
+      printf("Usage: %s [options] program.obj\n"
+	     "       %s [options] --batch=MANIFEST\n"
+	     "Runs the LC-3 program until it halts, without the debugger.\n"
+	     "\n"
+	     "  -i, --input=FILE     keyboard input of the program (default: stdin)\n"
+	     "  -o, --output=FILE    display output of the program (default: stdout)\n"
+	     "  -n, --max=COUNT      stop after COUNT instructions (default: %llu)\n"
+	     "  -r, --rootdir=DIR    root directory for files needed by lc3db\n"
+	     "  -q, --quiet          do not print the statistics on exit\n"
+	     "  -b, --batch=MANIFEST run the jobs listed in MANIFEST, one per line:\n"
+	     "                         OBJECT_FILE INPUT_FILE EXPECTED_OUTPUT [MAX_INSTRUCTIONS]\n"
+	     "                       (\"-\" for no input/no check), the results are written\n"
+	     "                       to OBJECT.out and OBJECT.result\n"
+	     "  -j, --jobs=N         number of jobs to run in parallel (default: all CPUs)\n"
+	     "  -c, --coverage=FILE  add the executed source lines and branches of the\n"
+	     "                       program (every job) to the lcov tracefile FILE\n"
+	     "  -t, --native-traps   do GETC, OUT, PUTS and IN in the simulator\n"
+	     "                       instead of the routines of the OS\n"
+	     "  -h, --help           displays this help screen\n"
+	     "\n"
+	     "The exit status is 0 when the program halted (all jobs passed), 2 when\n"
+	     "it ran out of instructions (some jobs failed) and 1 on errors.\n"
+	     , *argv, *argv, max_instructions);
+      exit(ch == 'h' ? 0 : 1);
+    }
+  }
+  if (coverage_file) {
+    coverage_report = new CoverageReport();
+    coverage_report->read(coverage_file);
+  }
+  if (manifest) {
+    int status = run_batch(manifest, threads, max_instructions, quiet);
+    return write_coverage(coverage_file) ? status : 1;
+  }
+  if (optind + 1 != argc) {
+    fprintf(stderr, "%s: one object file expected (see --help)\n", *argv);
+    return 1;
+  }
+
+  Memory mem;
+  SourceInfo src_info;
+  LC3::CPU cpu(mem);
+  Hardware hw(mem, cpu);
+  hw.set_native_traps(native_traps);
+
+  if (0xFFFF == load_prog("lib/los.obj", src_info, mem, NULL)) {
+    sprintf(los, "%s/lib/lc3db/los.obj", root);
+    if (0xFFFF == load_prog(los, src_info, mem, NULL)) {
+      fprintf(stderr, "%s: could not find los.obj\n", *argv);
+      return 1;
+    }
+  }
+  hw.record_os_traps();
+  uint16_t start_addr = load_prog(argv[optind], src_info, mem, NULL);
+  if (0xFFFF == start_addr) {
+    fprintf(stderr, "%s: failed to load %s\n", *argv, argv[optind]);
+    return 1;
+  }
+  mem[0x01FE] = start_addr;
+
+  int ifd = input ? open(input, O_RDONLY) : fileno(stdin);
+  int ofd = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : fileno(stdout);
+  if (ifd == -1 || ofd == -1) {
+    perror(ifd == -1 ? input : output);
+    return 1;
+  }
+  // nothing else reads the stdin here, it is read ahead as a file
+  hw.set_tty(ifd, ofd, true);
+
+  Coverage *coverage = coverage_report ? new Coverage() : NULL;
+  double started = now();
+  unsigned long long count = run(mem, cpu, hw, max_instructions, coverage);
+  double elapsed = now() - started;
+  if (coverage) {
+    coverage_report->add(*coverage, src_info, mem);
+    delete coverage;
+  }
+
+  bool halted = hw.halted();
+  if (!quiet) {
+    fprintf(stderr, "\n%s after %llu instructions, PC=x%04x, %.3f s (%.1f MIPS)\n",
+	    halted ? "Halted" : "Instruction limit reached",
+	    count, cpu.PC, elapsed, elapsed > 0 ? count / elapsed / 1e6 : 0.0);
+  }
+
+  if (!write_coverage(coverage_file)) {
+    return 1;
+  }
+  return halted ? 0 : 2;
+}
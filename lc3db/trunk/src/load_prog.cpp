@@ -0,0 +1,235 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *  Copyright (C) 2004  Ehren Kret <kret@cs.utexas.edu>
+ *  Copyright (C) 2010-2011  Edgar Lakis <edgar.lakis@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+
+#include "memory.hpp"
+#include "source_info.hpp"
+#include "debug_info_file.hpp"
+
+// Loads the object file and its debug information (the .dbgx or .dbg next
+// to it).
+// Shared by the debugger and the batch runner.
+uint16_t load_prog(const char *file, SourceInfo &src_info, Memory &mem, uint16_t *pEntry)
+{
+  char buf[4096];
+  const char *line_error = NULL;
+  int debugLine;
+  int linenum;
+  int fileId = -1;
+  int typeId = -1;
+  int addr, lastAddr;
+  int c;
+  FILE *f;
+  uint16_t ret;
+  const char *entryLabel = NULL;
+  std::string object = file;
+  std::string base = object.substr(0, object.rfind(".obj"));
+  std::string debug = base + ".dbg";
+
+  ret  = mem.load(object);
+  if (ret == 0xFFFF) return ret;
+
+  /* The binary debug information (`lc3as -x'), unless the text file
+   * was written after it.
+   */
+  struct stat text_stat, binary_stat;
+  if (stat((debug + "x").c_str(), &binary_stat) == 0 &&
+      (stat(debug.c_str(), &text_stat) != 0 || text_stat.st_mtime <= binary_stat.st_mtime)) {
+    DebugInfoFile *dbgx = new DebugInfoFile(debug + "x");
+    if (dbgx->is_open()) {
+      bool isHLL = dbgx->has_HLL_source();
+      dbgx->load(src_info);	// src_info takes it over
+      if (pEntry) {
+	*pEntry = (isHLL && src_info.symbol.count("main")) ? src_info.symbol["main"] : ret;
+      }
+      return ret;
+    }
+    delete dbgx;
+  }
+
+  f = fopen(debug.c_str(), "rt");
+  if (!f) return ret;
+
+  /* Instead of introducing one more special directive to the assembler,
+   * assume that we have C program if fileID > 0 was encountered.
+   * See processing of '@' lines below.
+   *
+  if (1 == fscanf(f, "ENTRY:%s\n", buf)) {
+    entryLabel = strdup(buf);
+  } else {
+    fprintf(stderr, "ENTRY label missing (will break on first word)\n");
+  }
+  */
+
+  /* Discard all previous Higher Level Language source information.
+   * The assembly level information is word based, and will be overwritten
+   * individually, to allow loading of multiple source files.
+   */
+  src_info.reset_HLL_info();
+  fprintf(stderr, "\n--------------------- starting parsing debug file: %s -------------------------------\n", debug.c_str());
+
+
+  debugLine = 0;
+  while (!feof(f)) {
+    debugLine++;
+    c = fgetc(f);
+
+    /* default error if not changed by parsing */
+    line_error = "Wrong line format";
+
+    switch(c) {
+    case '#':
+      if (1 == fscanf(f, "%d:", &fileId)) {
+	int i;
+        fgets(buf, sizeof(buf), f);
+	i = strlen(buf);
+	while (i>=1 && isspace(buf[i-1])) {
+	  i--;
+	  buf[i] = 0;
+	}
+        src_info.add_source_file(fileId, std::string(buf));
+	fprintf(stderr, "add_source_file: %d %s\n", fileId, buf);
+	line_error = NULL;
+      }
+      break;
+
+    case '!':
+      if (2 == fscanf(f, "%x:%s\n", &addr, buf)) {
+        src_info.symbol[buf] = addr;
+	line_error = NULL;
+      }
+      break;
+
+    case '@':
+      if (4 == fscanf(f, "%d:%d:%x:%x\n", &fileId, &linenum, &addr, &lastAddr)) {
+	src_info.add_source_line(addr & 0xFFFF, lastAddr & 0xFFFF, fileId, linenum);
+	if (fileId > 0) { /* Assume C source if non 0 file ID found */
+	  entryLabel = "main";
+	}
+	line_error = NULL;
+      }
+      break;
+
+    case 'T':
+      if (2 == fscanf(f, " %d=%s\n", &typeId, buf)) {
+	/* TODO: maybe it's better to have all the parsing/format in one place, so decode the type here */
+	src_info.add_type(typeId, buf);
+	line_error = NULL;
+      }
+      break;
+
+    case 'B':
+      {
+	char kind;
+	char functionName[256];
+	int level;
+        //fgets(buf, sizeof(buf), f);
+	//printf("buf: %s; Ret: %d; kind:%c, n:%s, l:%d, %04x\n", buf, sscanf(buf, " %c:%[^:]:%d:%x\n", &kind, functionName, &level, &addr), kind, functionName, level, addr);
+	//if (4 == sscanf(buf, " %c:%[^:]:%d:%x\n", &kind, functionName, &level, &addr)) {
+	if (4 == fscanf(f, " %c:%[^:]:%d:%x\n", &kind, functionName, &level, &addr)) {
+	  line_error = NULL;
+	  if (kind == 'S') {
+	    src_info.start_declaration_block(functionName, level, addr);
+	  } else if (kind == 'E') {
+	    src_info.finish_declaration_block(functionName, level, addr);
+	  } else {
+	    line_error = "Wrong declaration block kind ('S':start or 'E':end expected)";
+	  }
+	}
+      }
+      break;
+
+    case 'S':
+      {
+	char kind;
+	char functionName[256];
+	char info1[256];
+	char info2[256];
+	int level;
+	if (4 == fscanf(f, " %c%d:%[^:]:%s\n", &kind, &typeId, info1, info2)) {
+	  line_error = NULL;
+	  /* maybe it's better to have all the parsing/format in one place, so we decode the symbol here */
+	  switch (kind) {
+	    case 'G':
+	    case 'S':
+	    case 's':
+	      {
+		VariableKind varKind = (kind=='G') ? FileGlobal : (kind=='S') ? FileStatic : FunctionStatic;
+		// Scope, Type, C (source) name, LC3 (assembler) label
+		src_info.add_absolute_variable(varKind, typeId, info1, info2);
+	      }
+	      break;
+	    case 'l':
+	    case 'p':
+	      {
+		int offset = atoi(info2);
+		VariableKind varKind = (kind=='l') ? FunctionLocal : FunctionParameter;
+		// Scope, Type, C (source) name, Frame offset
+		src_info.add_stack_variable(varKind, typeId, info1, offset);
+	      }
+	      break;
+	    case 'F':
+	    case 'f':
+	      {
+		int isStatic = ('f'==kind); // Is this static or global function
+		// isStatic, ReturnType, C (source) name, LC3 (assembler) label
+		src_info.add_function(isStatic, typeId, info1, info2);
+	      }
+	      break;
+
+	    default:
+	      line_error = "Unrecognised symbol kind";
+	  }
+	}
+      }
+      break;
+
+    default:
+      	line_error = "Unrecognised line type";
+    }
+
+    if (line_error) {
+        fprintf(stderr, "%s in debug information file: %s (line: %d)\n", line_error, debug.c_str(), debugLine);
+        /* read reminder of the line */
+        fgets(buf, sizeof(buf), f);
+    }
+
+  }
+  fprintf(stderr, "---------------------------------------------------------------------------------\n");
+  src_info.index_addresses();
+
+  if (pEntry) {
+    if (entryLabel && src_info.symbol.count(entryLabel)) {
+      *pEntry = src_info.symbol[entryLabel];
+    } else {
+      *pEntry = ret;
+    }
+  }
+
+  return ret;
+}
@@ -41,6 +41,9 @@ extern "C" {
 char* path_ptr;
 int gdb_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
 	     bool gui_mode, bool quiet_mode, const char *exec_file);
+bool gdbserver_open(const char *spec, int &in, int &out);
+int gdbserver_mode(LC3::CPU &cpu, SourceInfo &src_info, Memory &mem, Hardware &hw,
+		   const char *exec_file, int in, int out);
 uint16_t load_prog(const char *file, SourceInfo &src_info, Memory &mem, uint16_t *entry);
 
 const char * PROGRAM = "LC-3 Simulator 1.0";
@@ -68,6 +71,7 @@ int main(int argc, char **argv)
     {"emacs"   , 0, 0, 'E'},
     {"ddd"     , 0, 0, 'D'},
     {"quiet"   , 0, 0, 'q'},
+    {"gdbserver", 1, 0, 'G'},
     {NULL      , 0, 0, 0}
   };
   const char *loc_path_ptr;
@@ -76,6 +80,7 @@ int main(int argc, char **argv)
   int index = 0;
   bool gui_mode = false;
   bool quiet_mode = false;
+  const char *gdbserver = NULL;
 
   loc_path_ptr = getenv("LC3DB_ROOT");
   if(loc_path_ptr == NULL) {
@@ -93,6 +98,10 @@ int main(int argc, char **argv)
       break;
     case 'C':
       break;
+    case 'G':
+      gdbserver = optarg;
+      quiet_mode = true;
+      break;
     case 'c':
       {
 	const char *args[] = {
@@ -109,6 +118,8 @@ int main(int argc, char **argv)
 	     "\n"
 	     "  -c, --compile=filename   compile filename and exit\n"
 	     "  -E, --emacs              launch emacs as a front end\n"
+	     "  -G, --gdbserver=PORT|-   serve the GDB remote protocol on a TCP\n"
+	     "                           port or on stdin/stdout\n"
 	     "  -D, --ddd                launch ddd as a front end\n"
 	     "  -h, --help               displays this help screen\n"
 	     "  -I, --initddd            reinitialize ddd display init (rm -rf ~/.lc3db)\n"
@@ -187,6 +198,12 @@ int main(int argc, char **argv)
     }
   }
 
+  // The stdin/stdout of the protocol are taken before any output
+  int gdb_in = -1, gdb_out = -1;
+  if (gdbserver && !gdbserver_open(gdbserver, gdb_in, gdb_out)) {
+    return 1;
+  }
+
   if (0xFFFF == load_prog("lib/los.obj", src_info, mem, NULL)) {
     sprintf(sys_string, "%s/lib/lc3db/los.obj", path_ptr);
     printf("Loading %s\n", sys_string);
@@ -238,5 +255,8 @@ int main(int argc, char **argv)
     }
   }
 
+  if (gdbserver) {
+    return gdbserver_mode(cpu, src_info, mem, hw, exec_file, gdb_in, gdb_out);
+  }
   return gdb_mode(cpu, src_info, mem, hw, gui_mode, quiet_mode, exec_file);
 }
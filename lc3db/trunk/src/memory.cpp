@@ -29,58 +29,63 @@
 
 MappedWord::~MappedWord() { }
 
-Word::Word(Memory &mem, uint16_t address)
-  : value(mem.mem[address]), mapped(mem.mapped_word(address))
+struct Memory::Page
 {
-}
+  int refs;	// snapshots holding the page
+  int16_t words[0x100];
+};
 
-Word::operator int16_t() const
+MappedWord *Memory::mapped_word(uint16_t index)
 {
-  if (mapped) {
-    return *mapped;
+  dma_map_t::iterator i = dma.find(index);
+  if (i != dma.end()) {
+    return i->second;
   }
-
-  return value;
+  return 0;
 }
 
-Word &Word::operator=(int16_t rhs)
+bool Memory::is_mapped(uint16_t index)
 {
-  if (mapped) {
-    *mapped = rhs;
-  } else {
-    value = rhs;
-  }
-
-  return *this;
+  return is_device_page(index) && dma.count(index);
 }
 
-Word Memory::operator[](uint16_t index)
+void Memory::code_written(uint16_t index)
 {
-  return Word(*this, index);
+  code[index] = 0;
+  if (code_watcher) {
+    code_watcher->code_modified(index);
+  }
 }
 
-MappedWord *Memory::mapped_word(uint16_t index)
+void Memory::set_code_watcher(CodeWatcher *watcher)
 {
-  if (dma.count(index)) {
-    return dma[index];
-  }
-  return 0;
+  code_watcher = watcher;
 }
 
-Memory::Memory()
+Memory::Memory() : now(0), next_event(UINT64_MAX), code_watcher(0),
+  last_epoch(0), snapshot_epoch(0)
 {
   const int size = 0x10000;
   mem = new int16_t[size];
+  code = new uint8_t[size];
 #warning "valgrind doesn't like memset/bzero"
   //bzero(&mem[0], (&mem[size]-&mem[0]));
   for (int i=0; i < size; i++) {
     mem[i] = 0;
+    code[i] = 0;
+  }
+  for (int i=0; i < 0x100; i++) {
+    device_page[i] = false;
+    page_epoch[i] = 0;
   }
+  // I/O page of the LC-3
+  device_page[0xFE] = true;
 }
 
 Memory::~Memory()
 {
   delete [] mem;
+  delete [] code;
 }
 
 uint16_t Memory::load(const std::string &filename)
@@ -101,6 +106,9 @@ uint16_t Memory::load(const std::string &filename)
 #if __BYTE_ORDER == __LITTLE_ENDIAN
   PC = ((PC << 8) | ((PC >> 8) & 0x00FF));
 #endif
+  for (i = PC; i < (PC + stats.st_size/2 - 1); i++) {
+    before_write(i);
+  }
   ::read(fd, &mem[PC], stats.st_size - 2);
 #if __BYTE_ORDER == __LITTLE_ENDIAN
   for (i = PC; i < (PC + stats.st_size/2 - 1); i++) {
@@ -108,20 +116,133 @@ uint16_t Memory::load(const std::string &filename)
   }
 #endif
   close(fd);
+
+  // The words were written behind the back of Word, drop the stale code
+  for (i = PC; i < (PC + stats.st_size/2 - 1); i++) {
+    if (code[i]) {
+      code_written(i);
+    }
+  }
   
   return PC;
 }
   
-void Memory::cycle()
+void Memory::register_dma(uint16_t address, MappedWord *word)
+{
+  dma[address] = word;
+  device_page[address >> 8] = true;
+}
+
+void Memory::schedule(MappedWord *word, uint64_t when)
 {
-  for (dma_map_t::iterator i = dma.begin(); i != dma.end(); ++i) {
-    i->second->cycle();
+  cancel(word);
+  events.insert(std::make_pair(when, word));
+  next_event = events.begin()->first;
+}
+
+void Memory::cancel(MappedWord *word)
+{
+  for (event_queue_t::iterator i = events.begin(); i != events.end(); ++i) {
+    if (i->second == word) {
+      events.erase(i);
+      break;
+    }
   }
+  next_event = events.empty() ? UINT64_MAX : events.begin()->first;
 }
 
-void Memory::register_dma(uint16_t address, MappedWord *word)
+void Memory::run_events()
 {
-  dma[address] = word;
+  while (!events.empty() && events.begin()->first <= now) {
+    MappedWord *word = events.begin()->second;
+    events.erase(events.begin());
+    // might schedule itself again
+    word->cycle();
+  }
+  next_event = events.empty() ? UINT64_MAX : events.begin()->first;
+}
+
+Memory::Snapshot::Snapshot(Memory &mem, unsigned epoch)
+  : mem(mem), epoch(epoch), now(mem.now), events(mem.events)
+{
+  for (int p=0; p < 0x100; p++) {
+    pages[p] = NULL;
+  }
+}
+
+Memory::Snapshot::~Snapshot()
+{
+  mem.release(this);
+}
+
+Memory::Snapshot *Memory::snapshot()
+{
+  Snapshot *s = new Snapshot(*this, ++last_epoch);
+  snapshots.push_back(s);
+  snapshot_epoch = last_epoch;
+  return s;
+}
+
+void Memory::preserve(int page)
+{
+  Page *copy = new Page;
+  copy->refs = 0;
+  memcpy(copy->words, &mem[page << 8], sizeof(copy->words));
+  for (std::list<Snapshot *>::iterator s = snapshots.begin(); s != snapshots.end(); ++s) {
+    if (!(*s)->pages[page]) {
+      (*s)->pages[page] = copy;
+      copy->refs++;
+    }
+  }
+  if (!copy->refs) {
+    delete copy;
+  }
+  page_epoch[page] = snapshot_epoch;
+}
+
+void Memory::restore(const Snapshot *snapshot)
+{
+  for (int p=0; p < 0x100; p++) {
+    const Page *page = snapshot->pages[p];
+    if (!page) {
+      continue;
+    }
+    // the other snapshots might still share the current content
+    if (page_epoch[p] < snapshot_epoch) {
+      preserve(p);
+    }
+    for (int i=0; i < 0x100; i++) {
+      uint16_t index = (p << 8) | i;
+      if (mem[index] != page->words[i]) {
+	mem[index] = page->words[i];
+	if (code[index]) {
+	  code_written(index);
+	}
+      }
+    }
+  }
+
+  now = snapshot->now;
+  events = snapshot->events;
+  next_event = events.empty() ? UINT64_MAX : events.begin()->first;
+}
+
+void Memory::release(Snapshot *snapshot)
+{
+  for (int p=0; p < 0x100; p++) {
+    Page *page = snapshot->pages[p];
+    if (page && --page->refs == 0) {
+      delete page;
+    }
+  }
+  snapshots.remove(snapshot);
+
+  snapshot_epoch = 0;
+  for (std::list<Snapshot *>::iterator s = snapshots.begin(); s != snapshots.end(); ++s) {
+    if ((*s)->epoch > snapshot_epoch) {
+      snapshot_epoch = (*s)->epoch;
+    }
+  }
 }
 
 // vim: sw=2 si:
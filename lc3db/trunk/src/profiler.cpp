@@ -0,0 +1,219 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "profiler.hpp"
+
+Profiler::Profiler() :
+  counts(0x10000), ticks(0), since(0)
+{
+}
+
+void Profiler::reset()
+{
+  std::fill(counts.begin(), counts.end(), 0);
+  since = ticks;
+  calls.clear();
+}
+
+void Profiler::returned(const CallStack::Frame &frame, uint64_t count)
+{
+  add_call(frame, count, calls);
+}
+
+// The call of frame, up to clock() count, the instructions before the
+// reset not counted
+void Profiler::add_call(const CallStack::Frame &frame, uint64_t count, calls_t &to) const
+{
+  Calls &c = to[std::make_pair(frame.site, frame.target)];
+  c.count++;
+  c.inclusive += count - std::max(frame.start, since);
+}
+
+// The calls, with the ones still running counted up to now
+Profiler::calls_t Profiler::all_calls(const CallStack &running) const
+{
+  calls_t all = calls;
+  for (size_t i = 0; i < running.depth(); i++) {
+    add_call(running[i], ticks, all);
+  }
+  return all;
+}
+
+// Function of the addresses: the C function of the source block, else the
+// nearest call target (or assembler label, before the first one) at or
+// before the address
+class FunctionNames
+{
+public:
+  FunctionNames(SourceInfo &src_info, const Profiler::calls_t &calls) : src_info(src_info) {
+    for (std::map<std::string, uint16_t>::const_iterator i = src_info.symbol.begin();
+	 i != src_info.symbol.end(); ++i) {
+      labels.insert(std::make_pair(i->second, i->first));
+    }
+    for (Profiler::calls_t::const_iterator c = calls.begin(); c != calls.end(); ++c) {
+      uint16_t target = c->first.second;
+      std::map<uint16_t, std::string>::const_iterator l = labels.find(target);
+      if (l != labels.end()) {
+	entries[target] = l->second;
+      } else {
+	char buf[8];
+	sprintf(buf, "x%.4X", target);
+	entries[target] = buf;
+      }
+    }
+  }
+
+  std::string operator()(uint16_t address) {
+    SourceBlock *block = src_info.find_source_block(address);
+    if (block && block->function) {
+      return block->function->name;
+    }
+    std::map<uint16_t, std::string>::const_iterator i = entries.upper_bound(address);
+    if (i != entries.begin()) {
+      return (--i)->second;
+    }
+    i = labels.upper_bound(address);
+    if (i == labels.begin()) {
+      return "???";
+    }
+    return (--i)->second;
+  }
+
+private:
+  SourceInfo &src_info;
+  std::map<uint16_t, std::string> labels;	// first label of the addresses
+  std::map<uint16_t, std::string> entries;	// called addresses
+};
+
+static std::string line_name(const SourceLocation &loc)
+{
+  char buf[32];
+  sprintf(buf, ":%d", loc.lineNo);
+  return std::string(loc.fileName) + buf;
+}
+
+static bool by_count(const std::pair<std::string, uint64_t> &a,
+		     const std::pair<std::string, uint64_t> &b)
+{
+  return a.second > b.second || (a.second == b.second && a.first < b.first);
+}
+
+static void print_top(FILE *out, const char *title, const std::map<std::string, uint64_t> &costs,
+		      uint64_t total, int count)
+{
+  std::vector<std::pair<std::string, uint64_t> > sorted(costs.begin(), costs.end());
+  std::sort(sorted.begin(), sorted.end(), by_count);
+
+  fprintf(out, "%12s %6s  %s\n", "Instructions", "%", title);
+  for (int i = 0; i < (int)sorted.size() && i < count; i++) {
+    fprintf(out, "%12llu %5.1f%%  %s\n", (unsigned long long)sorted[i].second,
+	    100.0 * sorted[i].second / total, sorted[i].first.c_str());
+  }
+}
+
+void Profiler::report(SourceInfo &src_info, const CallStack &running, FILE *out, int count)
+{
+  FunctionNames function(src_info, all_calls(running));
+  std::map<std::string, uint64_t> functions, lines;
+  uint64_t total = instructions();
+
+  if (total == 0) {
+    fprintf(out, "No instructions profiled.\n");
+    return;
+  }
+  for (int pc = 0; pc < 0x10000; pc++) {
+    if (counts[pc]) {
+      functions[function(pc)] += counts[pc];
+      SourceLocation loc = src_info.find_source_location_short(pc);
+      if (loc.lineNo > 0) {
+	lines[line_name(loc)] += counts[pc];
+      }
+    }
+  }
+
+  fprintf(out, "Profile of %llu instructions\n\n", (unsigned long long)total);
+  print_top(out, "Function (self)", functions, total, count);
+  fprintf(out, "\n");
+  print_top(out, "Source line", lines, total, count);
+}
+
+// Callgrind format, positions are the address and the source line
+bool Profiler::write_callgrind(SourceInfo &src_info, const CallStack &running,
+			       const char *file_name)
+{
+  FILE *out = fopen(file_name, "w");
+  if (!out) {
+    return false;
+  }
+
+  calls_t all = all_calls(running);
+  FunctionNames function(src_info, all);
+  uint64_t total = instructions();
+
+  // costs and calls grouped by function (an interrupted address may
+  // have calls without being executed)
+  std::multimap<uint16_t, calls_t::const_iterator> calls_from;
+  for (calls_t::const_iterator c = all.begin(); c != all.end(); ++c) {
+    calls_from.insert(std::make_pair(c->first.first, c));
+  }
+  std::map<std::string, std::vector<uint16_t> > addresses;
+  for (int pc = 0; pc < 0x10000; pc++) {
+    if (counts[pc] || calls_from.count(pc)) {
+      addresses[function(pc)].push_back(pc);
+    }
+  }
+
+  fprintf(out, "# callgrind format\n"
+	  "version: 1\n"
+	  "creator: lc3db\n"
+	  "positions: instr line\n"
+	  "events: Instructions\n"
+	  "summary: %llu\n", (unsigned long long)total);
+
+  for (std::map<std::string, std::vector<uint16_t> >::const_iterator f = addresses.begin();
+       f != addresses.end(); ++f) {
+    SourceLocation loc = src_info.find_source_location_short(f->second.front());
+    fprintf(out, "\nfl=%s\nfn=%s\n", loc.lineNo > 0 ? loc.fileName : "???", f->first.c_str());
+    for (size_t i = 0; i < f->second.size(); i++) {
+      uint16_t pc = f->second[i];
+      int line = std::max(src_info.find_source_location_short(pc).lineNo, 0);
+      fprintf(out, "0x%04x %d %llu\n", pc, line, (unsigned long long)counts[pc]);
+
+      std::multimap<uint16_t, calls_t::const_iterator>::const_iterator c, end;
+      for (c = calls_from.lower_bound(pc), end = calls_from.upper_bound(pc); c != end; ++c) {
+	uint16_t target = c->second->first.second;
+	SourceLocation target_loc = src_info.find_source_location_short(target);
+	fprintf(out, "cfl=%s\ncfn=%s\n", target_loc.lineNo > 0 ? target_loc.fileName : "???",
+		function(target).c_str());
+	fprintf(out, "calls=%llu 0x%04x %d\n", (unsigned long long)c->second->second.count,
+		target, std::max(target_loc.lineNo, 0));
+	fprintf(out, "0x%04x %d %llu\n", pc, line, (unsigned long long)c->second->second.inclusive);
+      }
+    }
+  }
+
+  return fclose(out) == 0;
+}
+
+// vim: sw=2 si:
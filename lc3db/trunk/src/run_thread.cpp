@@ -0,0 +1,128 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+
+#include "run_thread.hpp"
+
+RunThread::RunThread() :
+  requests(0), sequence(0), started(false), job(NULL), job_arg(NULL),
+  running(false), quit(false)
+{
+  published.PC = published.PSR = 0;
+  for (int i=0; i < 8; i++) {
+    published.R[i] = 0;
+  }
+  published.instructions = 0;
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&changed, NULL);
+}
+
+RunThread::~RunThread()
+{
+  if (started) {
+    post(INTERRUPT);
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+  }
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+}
+
+void RunThread::start(void (*job)(void *), void *arg)
+{
+  pthread_mutex_lock(&lock);
+  if (!started) {
+    started = (pthread_create(&thread, NULL, run, this) == 0);
+  }
+  if (!started) {
+    // no thread, run it here
+    pthread_mutex_unlock(&lock);
+    job(arg);
+    return;
+  }
+  this->job = job;
+  job_arg = arg;
+  running = true;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+void RunThread::wait()
+{
+  pthread_mutex_lock(&lock);
+  while (running) {
+    pthread_cond_wait(&changed, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+void *RunThread::run(void *arg)
+{
+  RunThread *t = (RunThread *)arg;
+
+  pthread_mutex_lock(&t->lock);
+  for (;;) {
+    while (!t->job && !t->quit) {
+      pthread_cond_wait(&t->changed, &t->lock);
+    }
+    if (!t->job) {
+      break;
+    }
+    pthread_mutex_unlock(&t->lock);
+    t->job(t->job_arg);
+    pthread_mutex_lock(&t->lock);
+    t->job = NULL;
+    t->running = false;
+    pthread_cond_broadcast(&t->changed);
+  }
+  pthread_mutex_unlock(&t->lock);
+  return NULL;
+}
+
+void RunThread::publish(const LC3::CPU &cpu, int instructions)
+{
+  sequence++;
+  __sync_synchronize();
+  published.PC = cpu.PC;
+  published.PSR = cpu.PSR;
+  for (int i=0; i < 8; i++) {
+    published.R[i] = cpu.R[i];
+  }
+  published.instructions = instructions;
+  __sync_synchronize();
+  sequence++;
+}
+
+RunThread::Status RunThread::status() const
+{
+  Status s;
+  unsigned before;
+
+  do {
+    before = sequence;
+    __sync_synchronize();
+    s = published;
+    __sync_synchronize();
+  } while ((before & 1) || before != sequence);
+  return s;
+}
+// vim: sw=2 si:
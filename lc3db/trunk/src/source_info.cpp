@@ -27,6 +27,7 @@
 #include <stack>
 #include <algorithm>
 #include "source_info.hpp"
+#include "debug_info_file.hpp"
 
 // Internal source locations
 struct _MachineSourceLocation
@@ -76,24 +77,62 @@ struct _SourceLocation
     fileId(ml.fileId),lineNo(ml.lineNo),
     isHLLSource(true), firstAddr(ml.firstAddr), lastAddr(ml.lastAddr) {}
 
-  SourceLocation toUser(std::vector<std::string> names) {
+  SourceLocation toUser(const std::vector<std::string> &names) {
     return SourceLocation(names[fileId].c_str(), lineNo, isHLLSource, firstAddr, lastAddr);
   }
 };
 
 
-SourceInfo::SourceInfo() {}
-SourceInfo::~SourceInfo() {}
+SourceInfo::SourceInfo() : verbose(true), addressesIndexed(false) {}
+SourceInfo::~SourceInfo() {
+  for (size_t i = 0; i < deferredLines.size(); i++) {
+    delete deferredLines[i].file;
+  }
+}
 
 void SourceInfo::reset_HLL_info(void)
 {
   // FixMe: Is this enough or should we clean-up each element (find out about memory management of the map). 
   HLLSources.clear();
+  for (size_t i = 0; i < deferredLines.size(); i++) {
+    deferredLines[i].HLL = false;
+  }
+  addressesIndexed = false;
+}
+
+/* Takes over a loaded DebugInfoFile, its lines are added by the first
+ * lookup needing them.  A reloaded file replaces the pending one.
+ */
+void SourceInfo::add_deferred_lines(DebugInfoFile *file)
+{
+  for (size_t i = 0; i < deferredLines.size(); i++) {
+    if (deferredLines[i].file->name() == file->name()) {
+      delete deferredLines[i].file;
+      deferredLines.erase(deferredLines.begin() + i);
+      break;
+    }
+  }
+  DeferredLines lines = { file, true };
+  deferredLines.push_back(lines);
+  addressesIndexed = false;
+}
+
+void SourceInfo::load_deferred_lines()
+{
+  std::vector<DeferredLines> pending;
+  pending.swap(deferredLines);
+  for (size_t i = 0; i < pending.size(); i++) {
+    pending[i].file->load_lines(*this, pending[i].HLL);
+    delete pending[i].file;
+  }
 }
 
 int SourceInfo::add_source_file(int fileId, std::string filePath)
 {
   int i;
+  if (!deferredLines.empty()) {	// keep the order of the loads
+    load_deferred_lines();
+  }
   for (i=0; i < filePaths.size(); i++) {
     if (filePath == filePaths[i]) {
       internalIds[fileId] = i;
@@ -121,8 +160,12 @@ int SourceInfo::add_source_file(int fileId, std::string filePath)
  */
 void SourceInfo::add_source_line(uint16_t lineStart, uint16_t lineEnd, int userFileId, int lineNo)
 {
+  if (!deferredLines.empty()) {
+    load_deferred_lines();
+  }
   int internalFileId = internalIds[userFileId];
   assert(internalFileId < filePaths.size());
+  addressesIndexed = false;
 
   // Add element for source lookup
   if (userFileId == 0) { // Machine source
@@ -165,7 +208,9 @@ static std::stack<SourceBlock*> openedBlocks;
  */
 void SourceInfo::start_declaration_block(const char* functionName, int level, uint16_t address){
   // All types are hardcoded to int for now, this function doesn't do anything
-  fprintf(stderr, "%*s{  // in %s at 0x%04x\n", level*8, "", functionName, address);
+  if (verbose) {
+    fprintf(stderr, "%*s{  // in %s at 0x%04x\n", level*8, "", functionName, address);
+  }
   assert( (!currentBlock && !level) ||
      	 (level==(currentBlock->level+1)) );
   currentBlock = new SourceBlock(level, currentBlock, address, currentFunction);
@@ -182,13 +227,16 @@ void SourceInfo::start_declaration_block(const char* functionName, int level, ui
  * - address: the machine address where the block ends
  */
 void SourceInfo::finish_declaration_block(const char* functionName, int level, uint16_t address){
-  fprintf(stderr, "%*s}  // in %s at 0x%04x\n", level*8, "", functionName, address);
+  if (verbose) {
+    fprintf(stderr, "%*s}  // in %s at 0x%04x\n", level*8, "", functionName, address);
+  }
   assert( currentBlock && (level==(currentBlock->level)) );
   if (level != 0 && currentBlock->variables.empty()) {
     delete currentBlock;
   } else {
     currentBlock->end = address;
     sourceBlocks[currentBlock->start] = currentBlock;
+    addressesIndexed = false;
   }
   openedBlocks.pop();
   currentBlock = openedBlocks.empty() ? NULL : openedBlocks.top();
@@ -201,7 +249,8 @@ void SourceInfo::finish_declaration_block(const char* functionName, int level, u
  * - assemblerLabel: the assembler label which points the variable start address
  */
 void SourceInfo::add_absolute_variable(VariableKind kind, int typeId, const char* sourceName, const char* assemblerLabel){
-  if (kind==FileGlobal) {
+  if (!verbose) {
+  } else if (kind==FileGlobal) {
 	fprintf(stderr, "T%d %s \t// at %s\n", typeId, sourceName, assemblerLabel);
   } else if (kind==FileStatic) {
 	fprintf(stderr, "static T%d %s \t// at %s\n", typeId, sourceName, assemblerLabel);
@@ -231,7 +280,8 @@ void SourceInfo::add_absolute_variable(VariableKind kind, int typeId, const char
  *   the positive offsets are used for parameters and the rest for locals)
  */
 void SourceInfo::add_stack_variable(VariableKind kind, int typeId, const char* sourceName, int frameOffset){
-  if (kind==FunctionParameter) {
+  if (!verbose) {
+  } else if (kind==FunctionParameter) {
 	fprintf(stderr, "     param T%d %s \t// at R5[%d]\n", typeId, sourceName, frameOffset);
   } else if (kind==FunctionLocal) {
 	fprintf(stderr, "%*sT%d %s \t// at R5[%d]\n", currentBlockLevel*8+8, "", typeId, sourceName, frameOffset);
@@ -254,30 +304,19 @@ void SourceInfo::add_stack_variable(VariableKind kind, int typeId, const char* s
  * - assemblerLabel: the assembler label which points the function start address (entry point)
  */
 void SourceInfo::add_function(bool isStatic, int returnTypeId, const char* sourceName, const char* assemblerLabel){
-  fprintf(stderr, "%s%s returns T%d \t// at %s\n", isStatic?"static ":"", sourceName, returnTypeId, assemblerLabel);
+  if (verbose) {
+    fprintf(stderr, "%s%s returns T%d \t// at %s\n", isStatic?"static ":"", sourceName, returnTypeId, assemblerLabel);
+  }
 
   assert(symbol.count(assemblerLabel)==1);
   currentFunction = new FunctionInfo(isStatic, returnTypeId, sourceName, symbol[assemblerLabel]);
 }
 
 SourceBlock* SourceInfo::find_source_block(uint16_t address){
-  std::map<uint16_t, SourceBlock*>::const_iterator it;
-
-  it = sourceBlocks.upper_bound(address);
-  if (it != sourceBlocks.begin()) {
-    it--;	// Find the largest block where block.start <= address
-    SourceBlock *sb = it->second;
-    while(sb) {
-      if (
-	address >= sb->start &&
-	address <= sb->end) {
-	return sb;
-      }
-      sb = sb->parent;
-    }
+  if (!addressesIndexed) {
+    index_addresses();
   }
-
-  return NULL;
+  return blockIndex[address];
 }
 
 
@@ -316,6 +355,9 @@ VariableInfo* SourceInfo::find_variable(uint16_t scopeAddress, const char* name)
 uint16_t SourceInfo::find_line_start_address(std::string fileName, int lineNo) 
 {
   int i;
+  if (!deferredLines.empty()) {
+    load_deferred_lines();
+  }
   for (i=0; i < filePaths.size(); i++) {
     if (fileName == fileNames[i]) {
       if (startAddresses[i].size() > lineNo) {
@@ -329,35 +371,17 @@ uint16_t SourceInfo::find_line_start_address(std::string fileName, int lineNo)
   return 0;
 }
 
-_SourceLocation SourceInfo::find_source_location(uint16_t address) 
+static bool by_level(const std::pair<int, SourceBlock*> &a, const std::pair<int, SourceBlock*> &b)
 {
-  std::map<uint16_t, _HLLSourceLocation>::const_iterator hit;
-  std::map<uint16_t, _MachineSourceLocation>::const_iterator mit;
-
-  /* Try higher level language info
-   */
-  hit = HLLSources.upper_bound(address);
-  if (hit != HLLSources.begin()) {
-    hit--;
-    //_HLLSourceLocation h = hit->second;
-    //fprintf(stderr, "LOW: %.4x: [%.4x,%.4x) in %d:%d\n", hit->first, h.firstAddr, h.lastAddr, h.fileId, h.lineNo);
-    if (
-      address >= hit->second.firstAddr &&
-      address <= hit->second.lastAddr) {
-      return _SourceLocation(hit->second);
-    }
-  }
+  return a.first < b.first;
+}
 
-  /* Fall back to assembly info
-   */
-  mit = machineSources.find(address);
-  if (mit != machineSources.end()) {
-    return _SourceLocation(mit->second, address);
+_SourceLocation SourceInfo::find_source_location(uint16_t address) 
+{
+  if (!addressesIndexed) {
+    index_addresses();
   }
-
-  /* No info
-   */
-  return _SourceLocation();
+  return lineRecords[lineIndex[address]];
 }
 
 SourceLocation SourceInfo::find_source_location_short(uint16_t address) 
@@ -372,5 +396,74 @@ SourceLocation SourceInfo::find_source_location_absolute(uint16_t address)
   return sl.toUser(filePaths);
 }
 
+/* Fills the tables answering find_source_location() and find_source_block()
+ * for every address:
+ * - the source line is the higher level language line whose range holds the
+ *   address (up to the start of the next line), else the assembly line
+ * - the source block is the innermost block holding the address
+ */
+void SourceInfo::index_addresses()
+{
+  std::map<uint16_t, _HLLSourceLocation>::const_iterator hit;
+  std::map<uint16_t, _MachineSourceLocation>::const_iterator mit;
+
+  if (!deferredLines.empty()) {
+    load_deferred_lines();
+  }
+  lineRecords.assign(1, _SourceLocation());
+  lineIndex.assign(0x10000, 0);
+  for (mit = machineSources.begin(); mit != machineSources.end(); ++mit) {
+    lineIndex[mit->first] = lineRecords.size();
+    lineRecords.push_back(_SourceLocation(mit->second, mit->first));
+  }
+  for (hit = HLLSources.begin(); hit != HLLSources.end(); ++hit) {
+    std::map<uint16_t, _HLLSourceLocation>::const_iterator next = hit;
+    int last = hit->second.lastAddr;
+    if (++next != HLLSources.end() && next->first <= last) {
+      last = next->first - 1;
+    }
+    uint32_t record = lineRecords.size();
+    lineRecords.push_back(_SourceLocation(hit->second));
+    for (int addr = std::max<int>(hit->first, hit->second.firstAddr); addr <= last; addr++) {
+      lineIndex[addr] = record;
+    }
+  }
+
+  // Outer blocks first, so the nested ones overwrite them
+  std::vector<std::pair<int, SourceBlock*> > blocks;
+  for (std::map<uint16_t, SourceBlock*>::const_iterator it = sourceBlocks.begin();
+       it != sourceBlocks.end(); ++it) {
+    blocks.push_back(std::make_pair(it->second->level, it->second));
+  }
+  std::stable_sort(blocks.begin(), blocks.end(), by_level);
+  blockIndex.assign(0x10000, (SourceBlock*)NULL);
+  for (size_t i = 0; i < blocks.size(); i++) {
+    SourceBlock *sb = blocks[i].second;
+    for (int addr = sb->start; addr <= sb->end; addr++) {
+      blockIndex[addr] = sb;
+    }
+  }
+
+  addressesIndexed = true;
+}
+
+std::vector<SourceLocation> SourceInfo::source_lines()
+{
+  std::vector<SourceLocation> lines;
+  std::map<uint16_t, _HLLSourceLocation>::const_iterator hit;
+  std::map<uint16_t, _MachineSourceLocation>::const_iterator mit;
+
+  if (!deferredLines.empty()) {
+    load_deferred_lines();
+  }
+
+  for (hit = HLLSources.begin(); hit != HLLSources.end(); ++hit) {
+    lines.push_back(_SourceLocation(hit->second).toUser(filePaths));
+  }
+  for (mit = machineSources.begin(); mit != machineSources.end(); ++mit) {
+    lines.push_back(_SourceLocation(mit->second, mit->first).toUser(filePaths));
+  }
+  return lines;
+}
 
 // vim: sw=2 si:
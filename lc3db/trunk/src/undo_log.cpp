@@ -0,0 +1,196 @@
+/*\
+ *  LC-3 Simulator
+ *  Copyright (C) 2004  Anthony Liguori <aliguori@cs.utexas.edu>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+\*/
+
+#include "undo_log.hpp"
+
+// Step layout in the ring, the header is repeated at the end to walk
+// the log backward:
+//   header, [accesses], PC, changed registers..., (address, old word)...,
+//   read address..., [accesses], header
+
+UndoLog::Registers::Registers(const LC3::CPU &cpu)
+{
+  reg[0] = cpu.PC;
+  reg[1] = cpu.PSR;
+  for (int i=0; i < 8; i++) {
+    reg[2 + i] = cpu.R[i];
+  }
+  reg[10] = cpu.USP;
+  reg[11] = cpu.SSP;
+}
+
+UndoLog::UndoLog(size_t max_bytes) : recording(false)
+{
+  set_limit(max_bytes);
+}
+
+int UndoLog::length(uint16_t header, uint16_t accesses)
+{
+  int regs = 0;
+  for (uint16_t mask = header & REG_MASK; mask; mask &= mask - 1) {
+    regs++;
+  }
+  if (!(header & ACCESSES)) {
+    return 3 + regs;
+  }
+  return 5 + regs + 2 * (accesses & 0xFF) + (accesses >> READS_SHIFT);
+}
+
+int UndoLog::length_at(size_t p, bool backward) const
+{
+  uint16_t header = buf[p];
+  uint16_t accesses = buf[position(p, backward ? -1 : 1)];
+  return length(header, accesses);
+}
+
+void UndoLog::push(const LC3::CPU &cpu, bool interrupt)
+{
+  Registers after(cpu);
+  uint16_t header = (writes || reads) ? ACCESSES : 0;
+  uint16_t accesses = writes | (reads << READS_SHIFT);
+
+  recording = false;
+  for (int i=1; i < 12; i++) {
+    if (before.reg[i] != after.reg[i]) {
+      header |= 1 << (i - 1);
+    }
+  }
+  if ((header & REG_MASK) == 0 && writes == 0 && before.reg[0] == after.reg[0]) {
+    // nothing happened (no device event was due)
+    return;
+  }
+  if (interrupt) {
+    header |= INTERRUPT;
+  }
+
+  size_t n = length(header, accesses);
+  if (n > buf.size()) {
+    return;
+  }
+  while (buf.size() - used < n) {
+    drop_oldest();
+  }
+  put(header);
+  if (header & ACCESSES) {
+    put(accesses);
+  }
+  put(before.reg[0]);
+  for (int i=1; i < 12; i++) {
+    if (header & (1 << (i - 1))) {
+      put(before.reg[i]);
+    }
+  }
+  for (int i=0; i < writes; i++) {
+    put(pending[i][0]);
+    put(pending[i][1]);
+  }
+  for (int i=0; i < reads; i++) {
+    put(read_addresses[i]);
+  }
+  if (header & ACCESSES) {
+    put(accesses);
+  }
+  put(header);
+  used += n;
+  count++;
+}
+
+void UndoLog::drop_oldest()
+{
+  size_t n = length_at(tail, false);
+  tail = position(tail, n);
+  used -= n;
+  count--;
+}
+
+bool UndoLog::undo(LC3::CPU &cpu, Memory &mem, Step &step)
+{
+  if (empty()) {
+    return false;
+  }
+  size_t end = position(head, -1);
+  uint16_t header = buf[end];
+  uint16_t accesses = (header & ACCESSES) ? buf[position(end, -1)] : 0;
+  size_t n = length(header, accesses);
+  size_t start = position(head, -n);
+  size_t p = start;
+
+  Registers regs(cpu);
+  p = position(p, (header & ACCESSES) ? 2 : 1);
+  regs.reg[0] = buf[p];
+  for (int i=1; i < 12; i++) {
+    if (header & (1 << (i - 1))) {
+      p = position(p, 1);
+      regs.reg[i] = buf[p];
+    }
+  }
+
+  // the last write first, the same word may have been written twice
+  step.interrupt = (header & INTERRUPT) != 0;
+  step.writes = accesses & 0xFF;
+  for (int i = step.writes - 1; i >= 0; i--) {
+    size_t w = position(p, 1 + 2 * i);
+    step.address[i] = buf[w];
+    mem[buf[w]] = buf[position(w, 1)];
+  }
+  step.reads = accesses >> READS_SHIFT;
+  for (int i = 0; i < step.reads; i++) {
+    step.read_address[i] = buf[position(p, 1 + 2 * step.writes + i)];
+  }
+
+  cpu.PC = regs.reg[0];
+  cpu.PSR = regs.reg[1];
+  for (int i=0; i < 8; i++) {
+    cpu.R[i] = regs.reg[2 + i];
+  }
+  cpu.USP = regs.reg[10];
+  cpu.SSP = regs.reg[11];
+
+  head = start;
+  used -= n;
+  count--;
+  return true;
+}
+
+uint16_t UndoLog::last_pc() const
+{
+  size_t end = position(head, -1);
+  uint16_t header = buf[end];
+  size_t start = position(head, -length_at(end, true));
+  return buf[position(start, (header & ACCESSES) ? 2 : 1)];
+}
+
+bool UndoLog::last_is_interrupt() const
+{
+  return (buf[position(head, -1)] & INTERRUPT) != 0;
+}
+
+void UndoLog::clear()
+{
+  head = tail = used = count = 0;
+  recording = false;
+}
+
+void UndoLog::set_limit(size_t max_bytes)
+{
+  buf.assign(max_bytes / sizeof(uint16_t), 0);
+  clear();
+}
+
+// vim: sw=2 si:
@@ -0,0 +1,240 @@
+/*									tab:8
+ *
+ * dbgx.c - conversion of the text debug information to the .dbgx format
+ *
+ * "Copyright (c) 2003 by Steven S. Lumetta."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright notice
+ * and the following two paragraphs appear in all copies of this software,
+ * that the files COPYING and NO_WARRANTY are included verbatim with
+ * any distribution, and that the contents of the file README are included
+ * verbatim as part of a file named README with any distribution.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE TO ANY PARTY FOR DIRECT,
+ * INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE AUTHOR
+ * HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS ON AN "AS IS"
+ * BASIS, AND THE AUTHOR NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT,
+ * UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:	    dbgx.c
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbgx.h"
+
+/* growing contents of a section */
+typedef struct dbgx_buffer_t dbgx_buffer_t;
+struct dbgx_buffer_t {
+    unsigned char* data;
+    size_t len;
+    size_t size;
+};
+
+static int failed = 0;
+
+static void
+put_bytes (dbgx_buffer_t* buf, const void* data, size_t len)
+{
+    if (buf->len + len > buf->size) {
+	size_t size = (buf->size == 0 ? 4096 : buf->size * 2);
+	unsigned char* grown;
+
+	while (size < buf->len + len)
+	    size *= 2;
+	if ((grown = realloc (buf->data, size)) == NULL) {
+	    if (!failed)
+		perror ("realloc");
+	    failed = 1;
+	    return;
+	}
+	buf->data = grown;
+	buf->size = size;
+    }
+    memcpy (buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void
+put16 (dbgx_buffer_t* buf, int value)
+{
+    unsigned char bytes[2];
+
+    bytes[0] = (value >> 8) & 0xFF;
+    bytes[1] = value & 0xFF;
+    put_bytes (buf, bytes, 2);
+}
+
+static void
+put32 (dbgx_buffer_t* buf, unsigned long value)
+{
+    put16 (buf, (value >> 16) & 0xFFFF);
+    put16 (buf, value & 0xFFFF);
+}
+
+/* appends the string, returns its offset */
+static unsigned long
+put_string (dbgx_buffer_t* strings, const char* str)
+{
+    unsigned long offset = strings->len;
+
+    put_bytes (strings, str, strlen (str) + 1);
+    return offset;
+}
+
+/* DBGX_FILES index of the last "#" line with the id, -1 if none */
+static int
+find_file (dbgx_buffer_t* files, int id)
+{
+    int i;
+
+    for (i = files->len / DBGX_FILE_SIZE - 1; i >= 0; i--) {
+	unsigned char* rec = files->data + i * DBGX_FILE_SIZE;
+	if (((rec[0] << 24) | (rec[1] << 16) | (rec[2] << 8) | rec[3]) == id)
+	    return i;
+    }
+    return -1;
+}
+
+int
+dbgx_write (const char* dbg_name, const char* dbgx_name)
+{
+    dbgx_buffer_t sections[DBGX_NUM_SECTIONS + 1];
+    dbgx_buffer_t header;
+    char line[4096], info1[4096], info2[4096];
+    char kind, subkind;
+    int line_no = 0, id, num, addr, last, file, len, i;
+    unsigned long offset;
+    FILE* in;
+    FILE* out;
+
+    if ((in = fopen (dbg_name, "r")) == NULL) {
+	perror (dbg_name);
+	return -1;
+    }
+    memset (sections, 0, sizeof (sections));
+    memset (&header, 0, sizeof (header));
+    failed = 0;
+    put_string (&sections[DBGX_STRINGS], "");
+
+    while (fgets (line, sizeof (line), in) != NULL) {
+	line_no++;
+	len = strlen (line);
+	while (len > 0 && isspace ((unsigned char)line[len - 1]))
+	    line[--len] = 0;
+
+	switch (line[0]) {
+	    case '#':
+		if (sscanf (line + 1, "%d:%n", &id, &num) == 1 && num > 0) {
+		    put32 (&sections[DBGX_FILES], id);
+		    put32 (&sections[DBGX_FILES],
+			   put_string (&sections[DBGX_STRINGS], line + 1 + num));
+		    continue;
+		}
+		break;
+	    case '!':
+		if (sscanf (line + 1, "%x:%s", &addr, info1) == 2) {
+		    put16 (&sections[DBGX_SYMBOLS], addr);
+		    put16 (&sections[DBGX_SYMBOLS], 0);
+		    put32 (&sections[DBGX_SYMBOLS],
+			   put_string (&sections[DBGX_STRINGS], info1));
+		    continue;
+		}
+		break;
+	    case '@':
+		if (sscanf (line + 1, "%d:%d:%x:%x", &id, &num, &addr,
+			    &last) == 4 &&
+		    (file = find_file (&sections[DBGX_FILES], id)) != -1) {
+		    put16 (&sections[DBGX_LINES], file);
+		    put16 (&sections[DBGX_LINES], 0);
+		    put32 (&sections[DBGX_LINES], num);
+		    put16 (&sections[DBGX_LINES], addr);
+		    put16 (&sections[DBGX_LINES], last);
+		    continue;
+		}
+		break;
+	    case 'T':
+		if (sscanf (line + 1, " %d=%s", &id, info1) == 2) {
+		    put32 (&sections[DBGX_TYPES], id);
+		    put32 (&sections[DBGX_TYPES],
+			   put_string (&sections[DBGX_STRINGS], info1));
+		    continue;
+		}
+		break;
+	    case 'B':
+		if (sscanf (line + 1, " %c:%[^:]:%d:%x", &subkind, info1, &num,
+			    &addr) == 4) {
+		    put_bytes (&sections[DBGX_SCOPES], "B", 1);
+		    put_bytes (&sections[DBGX_SCOPES], &subkind, 1);
+		    put16 (&sections[DBGX_SCOPES], addr);
+		    put32 (&sections[DBGX_SCOPES], num);
+		    put32 (&sections[DBGX_SCOPES],
+			   put_string (&sections[DBGX_STRINGS], info1));
+		    put32 (&sections[DBGX_SCOPES], 0);
+		    continue;
+		}
+		break;
+	    case 'S':
+		if (sscanf (line + 1, " %c%d:%[^:]:%s", &kind, &num, info1,
+			    info2) == 4) {
+		    put_bytes (&sections[DBGX_SCOPES], "S", 1);
+		    put_bytes (&sections[DBGX_SCOPES], &kind, 1);
+		    put16 (&sections[DBGX_SCOPES], 0);
+		    put32 (&sections[DBGX_SCOPES], num);
+		    put32 (&sections[DBGX_SCOPES],
+			   put_string (&sections[DBGX_STRINGS], info1));
+		    put32 (&sections[DBGX_SCOPES],
+			   put_string (&sections[DBGX_STRINGS], info2));
+		    continue;
+		}
+		break;
+	    case 0:
+		continue;
+	}
+	fprintf (stderr, "%s:%d: unrecognised debug information line\n",
+		 dbg_name, line_no);
+    }
+    fclose (in);
+
+    put_bytes (&header, DBGX_MAGIC, sizeof (DBGX_MAGIC));
+    put32 (&header, DBGX_VERSION);
+    put32 (&header, DBGX_NUM_SECTIONS);
+    offset = DBGX_HEADER_SIZE + DBGX_NUM_SECTIONS * DBGX_SECTION_SIZE;
+    for (i = 1; i <= DBGX_NUM_SECTIONS; i++) {
+	put32 (&header, i);
+	put32 (&header, offset);
+	put32 (&header, sections[i].len);
+	offset += sections[i].len;
+    }
+
+    if (failed) {
+	fprintf (stderr, "Could not convert %s.\n", dbg_name);
+    } else if ((out = fopen (dbgx_name, "wb")) == NULL) {
+	perror (dbgx_name);
+	failed = 1;
+    } else {
+	fwrite (header.data, 1, header.len, out);
+	for (i = 1; i <= DBGX_NUM_SECTIONS; i++)
+	    if (sections[i].len > 0)
+		fwrite (sections[i].data, 1, sections[i].len, out);
+	if (ferror (out) | fclose (out)) {
+	    perror (dbgx_name);
+	    failed = 1;
+	}
+    }
+
+    free (header.data);
+    for (i = 1; i <= DBGX_NUM_SECTIONS; i++)
+	free (sections[i].data);
+    return (failed ? -1 : 0);
+}
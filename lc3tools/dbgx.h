@@ -0,0 +1,78 @@
+/*									tab:8
+ *
+ * dbgx.h - indexed binary debug information, written by lc3as -x
+ *
+ * "Copyright (c) 2003 by Steven S. Lumetta."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright notice
+ * and the following two paragraphs appear in all copies of this software,
+ * that the files COPYING and NO_WARRANTY are included verbatim with
+ * any distribution, and that the contents of the file README are included
+ * verbatim as part of a file named README with any distribution.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE TO ANY PARTY FOR DIRECT,
+ * INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE AUTHOR
+ * HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS ON AN "AS IS"
+ * BASIS, AND THE AUTHOR NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT,
+ * UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:	    dbgx.h
+ */
+
+#ifndef DBGX_H
+#define DBGX_H
+
+/*
+   A .dbgx file holds the debug information of the text .dbg file, in
+   sections that lc3db maps into memory and decodes only when needed.  It
+   starts with DBGX_MAGIC (8 bytes), the version, the number of sections
+   and a directory entry per section: its id, offset and size in bytes.
+
+   All numbers are big endian.  The names are offsets into the
+   DBGX_STRINGS section of NUL terminated strings.  The records of the
+   other sections:
+
+     DBGX_FILES    ID PATH              (8 bytes)  source file of a "#" line,
+                                                   ID 0 is the assembly file
+     DBGX_SYMBOLS  ADDR 0 NAME          (8 bytes)  label of a "!" line
+     DBGX_TYPES    ID DESCRIPTOR        (8 bytes)  "T" line
+     DBGX_SCOPES   KIND SUBKIND ADDR NUMBER NAME INFO
+                                        (16 bytes) in the order of the
+                                                   "B" and "S" lines:
+                   'B' 'S'|'E' ADDR LEVEL FUNCTION 0 for the blocks,
+                   'S' KIND 0 TYPE SOURCE_NAME LABEL_OR_OFFSET for the
+                   symbols
+     DBGX_LINES    FILE 0 LINE FIRST LAST
+                                        (12 bytes) "@" line, FILE is the
+                                                   index of its DBGX_FILES
+                                                   record
+*/
+
+#define DBGX_MAGIC       "LC3DBGX"
+#define DBGX_VERSION     1
+
+typedef enum dbgx_section_t dbgx_section_t;
+enum dbgx_section_t {
+    DBGX_STRINGS = 1, DBGX_FILES, DBGX_SYMBOLS, DBGX_TYPES, DBGX_SCOPES,
+    DBGX_LINES, DBGX_NUM_SECTIONS = DBGX_LINES
+};
+
+#define DBGX_HEADER_SIZE  16      /* magic, version, number of sections */
+#define DBGX_SECTION_SIZE 12      /* id, offset, size */
+#define DBGX_FILE_SIZE    8
+#define DBGX_SYMBOL_SIZE  8
+#define DBGX_TYPE_SIZE    8
+#define DBGX_SCOPE_SIZE   16
+#define DBGX_LINE_SIZE    12
+
+/* Converts the text debug information, returns 0 on success */
+extern int dbgx_write (const char* dbg_name, const char* dbgx_name);
+
+#endif /* DBGX_H */
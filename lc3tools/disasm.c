@@ -0,0 +1,162 @@
+/*									tab:8
+ *
+ * disasm.c - instruction disassembly shared by lc3sim and lc3trace
+ *
+ * "Copyright (c) 2003 by Steven S. Lumetta."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright notice
+ * and the following two paragraphs appear in all copies of this software,
+ * that the files COPYING and NO_WARRANTY are included verbatim with
+ * any distribution, and that the contents of the file README are included
+ * verbatim as part of a file named README with any distribution.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE TO ANY PARTY FOR DIRECT,
+ * INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE AUTHOR
+ * HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS ON AN "AS IS"
+ * BASIS, AND THE AUTHOR NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT,
+ * UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:	    disasm.c
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lc3sim.h"
+#include "symbol.h"
+
+/* Disassembly format specification. */
+#define OPCODE_WIDTH 6
+
+static void
+print_operands (FILE *out, int addr, int inst, format_t fmt)
+{
+    int found = 0, tgt;
+
+    if (fmt & FMT_R1) {
+    	fprintf (out, "%sR%d", (found ? "," : ""), F_DR (inst));
+	found = 1;
+    }
+    if (fmt & FMT_R2) {
+    	fprintf (out, "%sR%d", (found ? "," : ""), F_SR1 (inst));
+	found = 1;
+    }
+    if (fmt & FMT_R3) {
+    	fprintf (out, "%sR%d", (found ? "," : ""), F_SR2 (inst));
+	found = 1;
+    }
+    if (fmt & FMT_IMMU4) {	/* DTU extension for immediate SLL and SRA */
+    	fprintf (out, "%s#%d", (found ? "," : ""), F_immu4 (inst));
+	found = 1;
+    }
+    if (fmt & FMT_IMM5) {
+    	fprintf (out, "%s#%d", (found ? "," : ""), F_imm5 (inst));
+	found = 1;
+    }
+    if (fmt & FMT_IMM6) {
+    	fprintf (out, "%s#%d", (found ? "," : ""), F_imm6 (inst));
+	found = 1;
+    }
+    if (fmt & FMT_VEC8) {
+    	fprintf (out, "%sx%02X", (found ? "," : ""), F_vec8 (inst));
+	found = 1;
+    }
+    if (fmt & FMT_ASC8) {
+    	fprintf (out, "%s", (found ? "," : ""));
+	found = 1;
+	switch (F_vec8 (inst)) {
+	    case  7: fprintf (out, "'\\a'"); break;
+	    case  8: fprintf (out, "'\\b'"); break;
+	    case  9: fprintf (out, "'\\t'"); break;
+	    case 10: fprintf (out, "'\\n'"); break;
+	    case 11: fprintf (out, "'\\v'"); break;
+	    case 12: fprintf (out, "'\\f'"); break;
+	    case 13: fprintf (out, "'\\r'"); break;
+	    case 27: fprintf (out, "'\\e'"); break;
+	    case 34: fprintf (out, "'\\\"'"); break;
+	    case 44: fprintf (out, "'\\''"); break;
+	    case 92: fprintf (out, "'\\\\'"); break;
+	    default:
+	    	if (isprint((unsigned char)F_vec8 (inst)))
+		    fprintf (out, "'%c'", F_vec8 (inst));
+		else
+		    fprintf (out, "x%02X", F_vec8 (inst));
+		break;
+	}
+    }
+    if (fmt & FMT_IMM9) {
+    	fprintf (out, "%s", (found ? "," : ""));
+	found = 1;
+	tgt = (addr + 1 + F_imm9 (inst)) & 0xFFFF;
+	if (lc3_sym_names[tgt] != NULL)
+	    fprintf (out, "%s", lc3_sym_names[tgt]->name);
+    	else
+	    fprintf (out, "x%04X", tgt);
+    }
+    if (fmt & FMT_IMM11) {
+    	fprintf (out, "%s", (found ? "," : ""));
+	found = 1;
+	tgt = (addr + 1 + F_imm11 (inst)) & 0xFFFF;
+	if (lc3_sym_names[tgt] != NULL)
+	    fprintf (out, "%s", lc3_sym_names[tgt]->name);
+    	else
+	    fprintf (out, "x%04X", tgt);
+    }
+    if (fmt & FMT_IMM16) {
+    	fprintf (out, "%s", (found ? "," : ""));
+	found = 1;
+	if (lc3_sym_names[inst] != NULL)
+	    fprintf (out, "%s", lc3_sym_names[inst]->name);
+    	else
+	    fprintf (out, "x%04X", inst);
+    }
+}
+
+void
+disassemble_inst (FILE* out, int addr, int inst, int breakpoint)
+{
+    static const char* const dis_cc[8] = {
+        "", "P", "Z", "ZP", "N", "NP", "NZ", "NZP"
+    };
+
+    /* Try to find a label. */
+    if (lc3_sym_names[addr] != NULL)
+	fprintf (out, "%c %16.16s x%04X x%04X ",
+		(breakpoint ? 'B' : ' '),
+		lc3_sym_names[addr]->name, addr, inst);
+    else
+	fprintf (out, "%c %17sx%04X x%04X ",
+		(breakpoint ? 'B' : ' '),
+		"", addr, inst);
+
+    /* Try to disassemble it. */
+
+#define DEF_INST(name,format,mask,match,flags,code)                        \
+    if ((inst & (mask)) == (match)) {                                      \
+	if ((format) & FMT_CC)                                             \
+	    fprintf (out, "%s%-*s", #name, (int)(OPCODE_WIDTH - strlen (#name)), \
+	    	    dis_cc[F_CC (inst) >> 9]);                             \
+	else                                                               \
+	    fprintf (out, "%-*s", OPCODE_WIDTH, #name);                          \
+	print_operands (out, addr, inst, (format));			           \
+	goto printed;                                                      \
+    }
+#define DEF_P_OP(name,format,mask,match) \
+    DEF_INST(name,format,mask,match,FLG_NONE,{})
+#include "lc3.def"
+#undef DEF_P_OP
+#undef DEF_INST
+
+    fprintf (out, "%-*s", OPCODE_WIDTH, "???");
+
+printed:
+    fputs ("\n", out);
+}
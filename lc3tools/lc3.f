@@ -53,6 +53,7 @@ part of the label?  Currently I allow only alpha followed by alphanum and _.
 #include <limits.h>
 
 #include "symbol.h"
+#include "dbgx.h"
 
 typedef enum opcode_t opcode_t;
 enum opcode_t {
@@ -475,9 +476,17 @@ main (int argc, char** argv)
     int len;
     char* ext;
     char* fname;
+    int write_dbgx = 0;
 
+    /* -x: also the indexed binary debug information for lc3db */
+    if (argc == 3 && strcmp (argv[1], "-x") == 0) {
+        write_dbgx = 1;
+        argv[1] = argv[2];
+        argc--;
+    }
     if (argc != 2) {
-        fprintf (stderr, "usage: %s <ASM filename>\n", argv[0]);
+        fprintf (stderr, "usage: %s [-x] <ASM filename>\n", argv[0]);
+        fprintf (stderr, "  -x  also write the debug information to FILE.dbgx\n");
 	return 1;
     }
 
@@ -611,6 +620,23 @@ main (int argc, char** argv)
     	fprintf(vcout, "others => X\"0000\"\n");
     fclose(vcout);
 
+    /* converted last, all the other outputs are complete if it fails */
+    if (write_dbgx) {
+        char* dbgx_name;
+        int failed;
+
+        strcpy (ext, ".dbg");
+        if ((dbgx_name = malloc (strlen (fname) + 2)) == NULL) {
+            perror ("malloc");
+            return 3;
+        }
+        sprintf (dbgx_name, "%sx", fname);
+        failed = dbgx_write (fname, dbgx_name);
+        free (dbgx_name);
+        if (failed != 0)
+            return 2;
+    }
+
     return 0;
 }
 
@@ -53,9 +53,7 @@
 
 #include "lc3sim.h"
 #include "symbol.h"
-
-/* Disassembly format specification. */
-#define OPCODE_WIDTH 6
+#include "trace.h"
 
 /* NOTE: hardcoded in scanfs! */
 #define MAX_CMD_WORD_LEN    41    /* command word limit + 1 */
@@ -99,6 +97,9 @@ static void disassemble_one_int (FILE *out, int addr);
 static void disassemble (int addr_s, int addr_e);
 static void dump_memory (int addr_s, int addr_e);
 static void run_until_stopped ();
+static void flush_output ();
+static void display_char (int c);
+static int native_trap (int vector);
 static void clear_breakpoint (int addr);
 static void clear_all_breakpoints ();
 static void list_breakpoints ();
@@ -189,14 +190,26 @@ static int sys_bpt_addr = -1, finish_depth = 0;
 static inst_flag_t last_flags;
 /* options and script recursion level */
 static int flush_on_start = 1, keep_input_on_stop = 1;
-static int rand_device = 1, delay_mem_update = 1;
+static int rand_device = 1, delay_mem_update = 1, buffer_output = 1;
 static int script_uses_stdin = 1, script_depth = 0;
+/* console TRAPs done by the simulator instead of the OS (off by default) */
+static int native_traps = 0;
+/* vector table entries x20-x24 of lc3os.obj, -1 if the OS is not loaded */
+static int os_trap_vector[5] = {-1, -1, -1, -1, -1};
 
 
-static FILE* traceout = NULL;
 static FILE* lc3in = NULL;
 static FILE* lc3out = NULL;
 static FILE* sim_in = NULL;
+
+/*
+   Display output is collected here and written on a newline, when the
+   buffer fills, when the LC-3 stops or waits for a key, and after
+   OUTPUT_IDLE_INSTS instructions without output.
+*/
+#define OUTPUT_IDLE_INSTS 10000
+static char output_buf[1024];
+static int output_len = 0, output_idle = 0;
 static char* (*lc3readline) (const char*) = simple_readline;
 
 static const char* const ccodes[8] = {
@@ -204,31 +217,78 @@ static const char* const ccodes[8] = {
     "NEGATIVE", "BAD_CC", "BAD_CC", "BAD_CC"
 };
 
+/*
+   GCC labels-as-values allow execute_instruction to jump straight to the
+   code of each instruction instead of testing the definitions in order.
+   Define NO_THREADED_DISPATCH to build the portable version.
+*/
+#if defined(__GNUC__) && !defined(NO_THREADED_DISPATCH)
+#define USE_THREADED_DISPATCH
+#define INST_LABEL(line)  INST_LABEL_(line)
+#define INST_LABEL_(line) inst_at_line_##line
+static void* dispatch[65536];
+static int dispatch_ready = 0;
+#endif
+
 
 static int
 execute_instruction ()
 {
-    if (traceout) {
-	fprintf(traceout, "; ");
-	disassemble_one_int (traceout, REG (R_PC));
-    }
     /* Fetch the instruction. */
-    REG (R_IR) = read_memory_traced (REG (R_PC));
+    REG (R_IR) = read_memory (REG (R_PC));
+    if (trace_on)
+	trace_fetch (REG (R_PC), REG (R_IR),
+		     lc3_breakpoints[REG (R_PC)] == BPT_USER);
     REG (R_PC) = (REG (R_PC) + 1) & 0xFFFF;
 
     /* Try to execute it. */
 
 #define ADD_FLAGS(value) (last_flags |= (value))
+#define DEF_P_OP(name,format,mask,match)
+#if defined(USE_THREADED_DISPATCH)
+    /*
+       The first call fills the table with the address of the code for
+       each instruction word (first matching definition wins, as in the
+       chain below); later calls jump there directly.  The labels are
+       made unique by the line of the definition in lc3.def.
+    */
+    if (!dispatch_ready) {
+	int inst;
+
+	for (inst = 0; inst < 65536; inst++) {
+	    dispatch[inst] = &&illegal_instruction;
+#define DEF_INST(name,format,mask,match,flags,code) \
+	    if ((inst & (mask)) == (match)) {       \
+		dispatch[inst] = &&INST_LABEL (__LINE__); \
+		continue;                           \
+	    }
+#include "lc3.def"
+#undef DEF_INST
+	}
+	dispatch_ready = 1;
+    }
+    goto *dispatch[REG (R_IR) & 0xFFFF];
+
+#define DEF_INST(name,format,mask,match,flags,code) \
+INST_LABEL (__LINE__):                              \
+    last_flags = (flags);                           \
+    code;                                           \
+    goto executed;
+#include "lc3.def"
+#undef DEF_INST
+
+illegal_instruction:
+#else
 #define DEF_INST(name,format,mask,match,flags,code) \
     if ((REG (R_IR) & (mask)) == (match)) {         \
 	last_flags = (flags);                       \
 	code;                                       \
 	goto executed;                              \
     }
-#define DEF_P_OP(name,format,mask,match)
 #include "lc3.def"
-#undef DEF_P_OP
 #undef DEF_INST
+#endif
+#undef DEF_P_OP
 #undef ADD_FLAGS
 
     REG (R_PC) = (REG (R_PC) - 1) & 0xFFFF;
@@ -239,12 +299,8 @@ execute_instruction ()
     return 0;
 
 executed:
-    if (traceout) {
-	fprintf(traceout, "newPC %04x, PSR %04x, GPR: %04x %04x %04x %04x  %04x %04x %04x %04x\n",
-			REG(R_PC) & 0xFFFF, REG(R_PSR) & 0xFFFF,
-			REG(0)&0xFFFF, REG(1)&0xFFFF, REG(2)&0xFFFF, REG(3)&0xFFFF,
-			REG(4)&0xFFFF, REG(5)&0xFFFF, REG(6)&0xFFFF, REG(7)&0xFFFF);
-    }
+    if (trace_on)
+	trace_registers (lc3_register);
 
     /* Check for user breakpoints. */
     if (lc3_breakpoints[REG (R_PC)] == BPT_USER) {
@@ -534,7 +590,7 @@ main (int argc, char** argv)
 	/* argv[0] may not be valid if -gui entered */
 	printf ("syntax: lc3sim [<object file>|<symbol file>]\n");
 	printf ("        lc3sim -s <script file>\n");
-	printf ("        lc3sim -t <trace file> <object file>|<symbol file>	# run the object file until the halt instruction, save the execution trace to file\n");
+	printf ("        lc3sim -t <trace file> <object file>|<symbol file>	# run the object file until the halt instruction, save the execution trace to file (print it with lc3trace)\n");
 	printf ("        lc3sim -h\n");
 	return 0;
     } else
@@ -558,6 +614,8 @@ read_memory (int addr)
 		p.events = POLLIN;
 		if (poll (&p, 1, 0) == 1 && (p.revents & POLLIN) != 0)
 		    last_KBSR_read = (!rand_device || (random () & 15) == 0);
+		else if (output_len > 0)
+		    flush_output (); /* show the prompt */
 	    }
 	    return (last_KBSR_read ? 0x8000 : 0x0000);
 	case 0xFE02: /* KBDR */
@@ -609,9 +667,8 @@ int
 read_memory_traced (int addr)
 {
 	int ret = read_memory(addr);
-	if (traceout) {
-		fprintf(traceout, "MEM[%04x] RD %04x\n", addr & 0xFFFF, ret & 0xFFFF);
-	}
+	if (trace_on)
+		trace_access (TRACE_READ, addr & 0xFFFF, ret & 0xFFFF);
 	return ret;
 }
 
@@ -627,8 +684,7 @@ write_memory (int addr, int value)
 	case 0xFE06: /* DDR */
 	    if (last_DSR_read == 0)
 	    	return;
-	    fprintf (lc3out, "%c", value);
-	    fflush (lc3out);
+	    display_char (value);
 	    last_DSR_read = 0;
 	    return;
     	case 0xFFFE:
@@ -670,12 +726,107 @@ write_memory (int addr, int value)
 void
 write_memory_traced (int addr, int value)
 {
-    if (traceout) {
-	fprintf(traceout, "MEM[%04x] WR %04x\n", addr & 0xFFFF, value & 0xFFFF);
-    }
+    if (trace_on)
+	trace_access (TRACE_WRITE, addr & 0xFFFF, value & 0xFFFF);
     write_memory(addr, value);
 }
 
+
+static void
+display_char (int c)
+{
+    output_buf[output_len++] = c;
+    if (!buffer_output || c == '\n' || output_len == sizeof (output_buf))
+	flush_output ();
+    else
+	output_idle = OUTPUT_IDLE_INSTS;
+}
+
+
+/* Condition codes of a value loaded into a register. */
+static void
+set_cc (int value)
+{
+    REG (R_PSR) &= ~0x0E00;
+    if ((value & 0x8000) != 0)
+	REG (R_PSR) |= 0x0800;
+    else if ((value & 0xFFFF) == 0)
+	REG (R_PSR) |= 0x0400;
+    else
+	REG (R_PSR) |= 0x0200;
+}
+
+
+/*
+   The console TRAPs of lc3os.asm done by the simulator (option traps),
+   with the registers and condition codes left as the OS routines leave
+   them.  The display is always ready.  GETC and IN without a key waiting
+   return 0 to let the OS routine poll for it.  The routines call each
+   other (PUTS calls OUT...), so once the program points any of the
+   vectors x20-x24 to its own routine, all of them go to the routines.
+   Returns 1 if the TRAP was done.
+*/
+static int
+native_trap (int vector)
+{
+    struct pollfd p;
+    const char* prompt;
+    int addr, word, n;
+
+    for (n = 0; n < 5; n++)
+	if (lc3_memory[0x20 + n] != os_trap_vector[n])
+	    return 0;
+
+    switch (vector) {
+	case 0x20: /* GETC */
+	case 0x23: /* IN */
+	    p.fd = fileno (lc3in);
+	    p.events = POLLIN;
+	    if (poll (&p, 1, 0) != 1 || (p.revents & POLLIN) == 0) {
+		flush_output (); /* show the prompt */
+	        return 0;
+	    }
+	    if (vector == 0x23)
+		for (prompt = "\nInput a character> "; *prompt; prompt++)
+		    display_char (*prompt);
+	    last_KBSR_read = 1;
+	    REG (R_R0) = read_memory (0xFE02);
+	    if (vector == 0x20) {
+		set_cc (REG (R_R0));
+		return 1;
+	    }
+	    display_char (REG (R_R0));
+	    display_char ('\n');
+	    break;
+	case 0x21: /* OUT */
+	    display_char (REG (R_R0));
+	    set_cc (REG (R_R1));
+	    return 1;
+	case 0x22: /* PUTS */
+	    for (addr = REG (R_R0), n = 0; n < 65536; addr++, n++) {
+		if ((word = read_memory (addr & 0xFFFF)) == 0)
+		    break;
+		display_char (word);
+	    }
+	    break;
+	case 0x24: /* PUTSP */
+	    for (addr = REG (R_R0), n = 0; n < 65536; addr++, n++) {
+		word = read_memory (addr & 0xFFFF);
+		if ((word & 0xFF) == 0)
+		    break;
+		display_char (word & 0xFF);
+		if ((word & 0xFF00) == 0)
+		    break;
+		display_char ((word >> 8) & 0xFF);
+	    }
+	    break;
+	default:
+	    return 0;
+    }
+    set_cc (REG (R_R7));
+    return 1;
+}
+
 static int
 read_obj_file (const char* filename, int* startp, int* endp)
 {
@@ -723,6 +874,8 @@ read_sym_file (const char* filename)
 	if (sscanf (buf, "%*s%80s%x", sym, &addr) != 2)
 	    break;
         add_symbol (sym, addr, 1);
+	if (trace_on)
+	    trace_symbol (addr, sym);
     }
     fclose (f);
     return 0;
@@ -734,6 +887,8 @@ squash_symbols (int addr_s, int addr_e)
 {
     while (addr_s != addr_e) {
 	remove_symbol_at_addr (addr_s);
+	if (trace_on)
+	    trace_symbol (addr_s, NULL);
 	addr_s = (addr_s + 1) & 0xFFFF;
     }
 }
@@ -742,7 +897,7 @@ squash_symbols (int addr_s, int addr_e)
 static void
 init_machine ()
 {
-    int os_start, os_end;
+    int os_start, os_end, i;
 
     in_init = 1;
 
@@ -753,6 +908,8 @@ init_machine ()
     bzero (lc3_sym_names, sizeof (lc3_sym_names));
     bzero (lc3_sym_hash, sizeof (lc3_sym_hash));
     clear_all_breakpoints ();
+    for (i = 0; i < 5; i++)
+	os_trap_vector[i] = -1;
 
     if (read_obj_file (INSTALL_DIR "/lc3os.obj", &os_start, &os_end) == -1) {
 	if (gui_mode)
@@ -767,6 +924,8 @@ init_machine ()
 	    else
 		puts ("Failed to read LC-3 OS symbols.");
 	}
+	for (i = 0; i < 5; i++)
+	    os_trap_vector[i] = lc3_memory[0x20 + i];
 	if (gui_mode) /* load new code into GUI display */
 	    disassemble (os_start, os_end);
 	REG (R_PC) = 0x0200;
@@ -842,9 +1001,22 @@ dump_delayed_mem_updates ()
 }
 
 
+static void
+flush_output ()
+{
+    if (output_len > 0) {
+	fwrite (output_buf, 1, output_len, lc3out);
+	fflush (lc3out);
+	output_len = 0;
+    }
+}
+
+
 static void
 show_state_if_stop_visible ()
 {
+    flush_output ();
+
     /*
        If the GUI has interrupted the simulator (e.g., to set or clear
        a breakpoint), print nothing.  The simulator restarts automatically
@@ -860,136 +1032,17 @@ show_state_if_stop_visible ()
 }
 
 
-static void
-print_operands (FILE *out, int addr, int inst, format_t fmt)
-{
-    int found = 0, tgt;
-
-    if (fmt & FMT_R1) {
-    	fprintf (out, "%sR%d", (found ? "," : ""), F_DR (inst));
-	found = 1;
-    }
-    if (fmt & FMT_R2) {
-    	fprintf (out, "%sR%d", (found ? "," : ""), F_SR1 (inst));
-	found = 1;
-    }
-    if (fmt & FMT_R3) {
-    	fprintf (out, "%sR%d", (found ? "," : ""), F_SR2 (inst));
-	found = 1;
-    }
-    if (fmt & FMT_IMMU4) {	/* DTU extension for immediate SLL and SRA */
-    	fprintf (out, "%s#%d", (found ? "," : ""), F_immu4 (inst));
-	found = 1;
-    }
-    if (fmt & FMT_IMM5) {
-    	fprintf (out, "%s#%d", (found ? "," : ""), F_imm5 (inst));
-	found = 1;
-    }
-    if (fmt & FMT_IMM6) {
-    	fprintf (out, "%s#%d", (found ? "," : ""), F_imm6 (inst));
-	found = 1;
-    }
-    if (fmt & FMT_VEC8) {
-    	fprintf (out, "%sx%02X", (found ? "," : ""), F_vec8 (inst));
-	found = 1;
-    }
-    if (fmt & FMT_ASC8) {
-    	fprintf (out, "%s", (found ? "," : ""));
-	found = 1;
-	switch (F_vec8 (inst)) {
-	    case  7: fprintf (out, "'\\a'"); break;
-	    case  8: fprintf (out, "'\\b'"); break;
-	    case  9: fprintf (out, "'\\t'"); break;
-	    case 10: fprintf (out, "'\\n'"); break;
-	    case 11: fprintf (out, "'\\v'"); break;
-	    case 12: fprintf (out, "'\\f'"); break;
-	    case 13: fprintf (out, "'\\r'"); break;
-	    case 27: fprintf (out, "'\\e'"); break;
-	    case 34: fprintf (out, "'\\\"'"); break;
-	    case 44: fprintf (out, "'\\''"); break;
-	    case 92: fprintf (out, "'\\\\'"); break;
-	    default:
-	    	if (isprint((unsigned char)F_vec8 (inst)))
-		    fprintf (out, "'%c'", F_vec8 (inst));
-		else
-		    fprintf (out, "x%02X", F_vec8 (inst));
-		break;
-	}
-    }
-    if (fmt & FMT_IMM9) {
-    	fprintf (out, "%s", (found ? "," : ""));
-	found = 1;
-	tgt = (addr + 1 + F_imm9 (inst)) & 0xFFFF;
-	if (lc3_sym_names[tgt] != NULL)
-	    fprintf (out, "%s", lc3_sym_names[tgt]->name);
-    	else
-	    fprintf (out, "x%04X", tgt);
-    }
-    if (fmt & FMT_IMM11) {
-    	fprintf (out, "%s", (found ? "," : ""));
-	found = 1;
-	tgt = (addr + 1 + F_imm11 (inst)) & 0xFFFF;
-	if (lc3_sym_names[tgt] != NULL)
-	    fprintf (out, "%s", lc3_sym_names[tgt]->name);
-    	else
-	    fprintf (out, "x%04X", tgt);
-    }
-    if (fmt & FMT_IMM16) {
-    	fprintf (out, "%s", (found ? "," : ""));
-	found = 1;
-	if (lc3_sym_names[inst] != NULL)
-	    fprintf (out, "%s", lc3_sym_names[inst]->name);
-    	else
-	    fprintf (out, "x%04X", inst);
-    }
-}
-
 static void
 disassemble_one_int (FILE* out, int addr)
 {
-    static const char* const dis_cc[8] = {
-        "", "P", "Z", "ZP", "N", "NP", "NZ", "NZP"
-    };
-    int inst = read_memory (addr);
-
     /* GUI prefix */
     if (gui_mode && out==stdout)
     	printf ("CODE%c%5d",
 	        (!in_init && addr == lc3_register[R_PC] ? 'P' : ' '),
 		addr + 1);
 
-    /* Try to find a label. */
-    if (lc3_sym_names[addr] != NULL)
-	fprintf (out, "%c %16.16s x%04X x%04X ",
-		(lc3_breakpoints[addr] == BPT_USER ? 'B' : ' '),
-		lc3_sym_names[addr]->name, addr, inst);
-    else
-	fprintf (out, "%c %17sx%04X x%04X ",
-		(lc3_breakpoints[addr] == BPT_USER ? 'B' : ' '),
-		"", addr, inst);
-
-    /* Try to disassemble it. */
-
-#define DEF_INST(name,format,mask,match,flags,code)                        \
-    if ((inst & (mask)) == (match)) {                                      \
-	if ((format) & FMT_CC)                                             \
-	    fprintf (out, "%s%-*s", #name, (int)(OPCODE_WIDTH - strlen (#name)), \
-	    	    dis_cc[F_CC (inst) >> 9]);                             \
-	else                                                               \
-	    fprintf (out, "%-*s", OPCODE_WIDTH, #name);                          \
-	print_operands (out, addr, inst, (format));			           \
-	goto printed;                                                      \
-    }
-#define DEF_P_OP(name,format,mask,match) \
-    DEF_INST(name,format,mask,match,FLG_NONE,{})
-#include "lc3.def"
-#undef DEF_P_OP
-#undef DEF_INST
-
-    fprintf (out, "%-*s", OPCODE_WIDTH, "???");
-
-printed:
-    fputs ("\n", out);
+    disassemble_inst (out, addr, read_memory (addr),
+		      lc3_breakpoints[addr] == BPT_USER);
 }
 
 static void
@@ -1061,7 +1114,11 @@ run_until_stopped ()
 	(void)tcsetattr (fileno (lc3in), TCSANOW, &tio);
     }
 
-    while (!should_halt && execute_instruction ());
+    while (!should_halt && execute_instruction ()) {
+	if (output_len > 0 && --output_idle == 0)
+	    flush_output ();
+    }
+    flush_output ();
 
     if (!tty_fail) {
 	tio.c_lflag = old_lflag;
@@ -1408,12 +1465,14 @@ cmd_file (const char* args)
 static void
 cmd_tracefile (const char* args)
 {
-    if (traceout)
-	fclose(traceout);
-    traceout = fopen(args, "w");
-    if (traceout)
-	printf("Trace of the state change during the simulation will be saved to \"%s\"\n", args);
-    else
+    static int closed_at_exit = 0;
+
+    if (trace_open (args) == 0) {
+	printf("Trace of the state change during the simulation will be saved to \"%s\" (decode it with lc3trace)\n", args);
+	if (!closed_at_exit)
+	    atexit (trace_close);
+	closed_at_exit = 1;
+    } else
 	printf("Error opening trace file \"%s\"\n", args);
 }
 
@@ -1654,6 +1713,22 @@ cmd_option (const char* args)
 			oval ? "" : "not ");
 	    return;
 	}
+        if (strncasecmp (opt, "traps", opt_len) == 0) {
+	    native_traps = oval;
+	    if (!gui_mode)
+		printf ("Will %sdo the console TRAPs in the simulator.\n",
+			oval ? "" : "not ");
+	    return;
+	}
+        if (strncasecmp (opt, "buffer", opt_len) == 0) {
+	    buffer_output = oval;
+	    if (!oval)
+		flush_output ();
+	    if (!gui_mode)
+		printf ("Will %sbuffer the LC-3 display output.\n",
+			oval ? "" : "not ");
+	    return;
+	}
 	/* GUI-only option: Delay memory updates to GUI until LC-3 stops? */
         if (gui_mode && strncasecmp (opt, "delay", opt_len) == 0) {
 	    /* Make sure that if the option is turned off while the GUI
@@ -1686,11 +1761,15 @@ show_syntax:
     printf ("syntax: option <option> on|off\n   options include:\n");
     printf ("      device -- simulate random device (keyboard/display)"
     	    "timing\n");
+    printf ("      buffer -- buffer display output until a newline or the "
+	    "LC-3 stops\n");
     printf ("      flush  -- flush console input each time LC-3 starts\n");
     printf ("      keep   -- keep remaining input when the LC-3 stops\n");
     printf ("      stdin  -- use stdin for LC-3 console input during script "
     	    "execution\n");
-    printf ("NOTE: all options are ON by default\n");
+    printf ("      traps  -- do GETC, OUT, PUTS, IN and PUTSP in the simulator "
+	    "instead\n                of the OS (breakpoints in them are not hit)\n");
+    printf ("NOTE: all options but traps are ON by default\n");
 }
 
 
@@ -35,6 +35,8 @@
 #ifndef LC3SIM_H
 #define LC3SIM_H
 
+#include <stdio.h>
+
 /* field access macros; "i" is an instruction */
 
 #define F_DR(i)    (((i) >> 9) & 0x7)
@@ -116,6 +118,9 @@ extern int read_memory_traced (int addr);
 extern void write_memory (int addr, int value);
 extern void write_memory_traced (int addr, int value);
 
+/* disasm.c: one line with the label, address, word and instruction */
+extern void disassemble_inst (FILE* out, int addr, int inst, int breakpoint);
+
 
 #endif /* LC3SIM_H */
 
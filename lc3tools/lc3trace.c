@@ -0,0 +1,204 @@
+/*									tab:8
+ *
+ * lc3trace.c - prints a binary trace of lc3sim in the text format
+ *
+ * "Copyright (c) 2003 by Steven S. Lumetta."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright notice
+ * and the following two paragraphs appear in all copies of this software,
+ * that the files COPYING and NO_WARRANTY are included verbatim with
+ * any distribution, and that the contents of the file README are included
+ * verbatim as part of a file named README with any distribution.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE TO ANY PARTY FOR DIRECT,
+ * INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE AUTHOR
+ * HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS ON AN "AS IS"
+ * BASIS, AND THE AUTHOR NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT,
+ * UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:	    lc3trace.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(USE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include "lc3sim.h"
+#include "symbol.h"
+#include "trace.h"
+
+static unsigned char block[TRACE_BLOCK_SIZE];
+static unsigned char stored[TRACE_BLOCK_SIZE + TRACE_BLOCK_SIZE / 512 + 64];
+
+static int regs[TRACE_NUM_REGS];
+
+#define GET16(p) (((p)[0] << 8) | (p)[1])
+
+static unsigned long
+get32 (const unsigned char* p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+           ((unsigned long)p[2] << 8) | p[3];
+}
+
+/*
+   Read the next block into "block", return its size, -1 at the end of
+   the file or -2 if the block is truncated or corrupted.
+*/
+static long
+read_block (FILE* f, const char* filename)
+{
+    unsigned char head[8];
+    unsigned long len, size;
+
+    if ((len = fread (head, 1, sizeof (head), f)) != sizeof (head)) {
+	if (len == 0)
+	    return -1;
+	fprintf (stderr, "%s: truncated block\n", filename);
+	return -2;
+    }
+    len = get32 (head);
+    size = get32 (head + 4);
+    if (len > TRACE_BLOCK_SIZE || size > len) {
+	fprintf (stderr, "%s: corrupted block\n", filename);
+	return -2;
+    }
+    if (fread (size == len ? block : stored, 1, size, f) != size) {
+	fprintf (stderr, "%s: truncated block\n", filename);
+	return -2;
+    }
+    if (size == len)
+	return len;
+#if defined(USE_ZLIB)
+    {
+	uLongf unpacked = sizeof (block);
+
+	if (uncompress (block, &unpacked, stored, size) == Z_OK &&
+	    unpacked == len)
+	    return len;
+    }
+    fprintf (stderr, "%s: corrupted block\n", filename);
+#else
+    fprintf (stderr, "%s: deflated block, lc3trace was built without zlib\n",
+    	     filename);
+#endif
+    return -2;
+}
+
+static void
+print_fetch (FILE* out, int pc, int inst, int breakpoint)
+{
+    fprintf (out, "; ");
+    disassemble_inst (out, pc, inst, breakpoint);
+    fprintf (out, "MEM[%04x] RD %04x\n", pc, inst);
+}
+
+/* Print the records of a block, return -1 if one is malformed. */
+static int
+print_block (FILE* out, long len)
+{
+    const unsigned char* p = block;
+    const unsigned char* end = block + len;
+    char name[256];
+    int tag, mask, i, n;
+
+    while (p < end) {
+	tag = *p++;
+	switch (tag & ~TRACE_BREAKPOINT) {
+	    case TRACE_INST:
+		regs[TRACE_PC] = GET16 (p);
+		p += 2;
+		/* fall through */
+	    case TRACE_INST_NEXT:
+		print_fetch (out, regs[TRACE_PC], GET16 (p),
+			     tag & TRACE_BREAKPOINT);
+		p += 2;
+		regs[TRACE_PC] = (regs[TRACE_PC] + 1) & 0xFFFF;
+		break;
+	    case TRACE_READ:
+	    case TRACE_WRITE:
+		fprintf (out, "MEM[%04x] %s %04x\n", GET16 (p),
+			 (tag == TRACE_READ ? "RD" : "WR"), GET16 (p + 2));
+		p += 4;
+		break;
+	    case TRACE_REGS:
+		mask = GET16 (p);
+		p += 2;
+		for (i = 0; i < TRACE_NUM_REGS; i++) {
+		    if (mask & (1 << i)) {
+			regs[i] = GET16 (p);
+			p += 2;
+		    }
+		}
+		fprintf (out, "newPC %04x, PSR %04x, GPR: "
+			 "%04x %04x %04x %04x  %04x %04x %04x %04x\n",
+			 regs[TRACE_PC], regs[TRACE_PSR],
+			 regs[0], regs[1], regs[2], regs[3],
+			 regs[4], regs[5], regs[6], regs[7]);
+		break;
+	    case TRACE_SYMBOL:
+		n = p[2];
+		memcpy (name, p + 3, n);
+		name[n] = 0;
+		remove_symbol_at_addr (GET16 (p));
+		if (n > 0)
+		    add_symbol (name, GET16 (p), 1);
+		p += 3 + n;
+		break;
+	    default:
+		return -1;
+	}
+    }
+    return (p == end ? 0 : -1);
+}
+
+int
+main (int argc, char** argv)
+{
+    FILE* in;
+    FILE* out = stdout;
+    unsigned char head[6];
+    long len;
+
+    if (argc == 4 && strcmp (argv[2], "-o") == 0) {
+	if ((out = fopen (argv[3], "w")) == NULL) {
+	    perror (argv[3]);
+	    return 1;
+	}
+    } else if (argc != 2) {
+	printf ("syntax: lc3trace <trace file> [-o <text file>]\n");
+	printf ("        prints the trace saved by lc3sim -t in the text format\n");
+	return 1;
+    }
+    if ((in = fopen (argv[1], "rb")) == NULL) {
+	perror (argv[1]);
+	return 1;
+    }
+    if (fread (head, 1, sizeof (head), in) != sizeof (head) ||
+        memcmp (head, TRACE_MAGIC, 4) != 0 || head[4] != TRACE_VERSION) {
+	fprintf (stderr, "%s: not an lc3sim trace\n", argv[1]);
+	return 1;
+    }
+
+    regs[TRACE_PC] = -1;
+    while ((len = read_block (in, argv[1])) >= 0) {
+	if (print_block (out, len) != 0) {
+	    fprintf (stderr, "%s: corrupted record\n", argv[1]);
+	    return 1;
+	}
+    }
+    fclose (in);
+    fclose (out);
+    return (len == -1 ? 0 : 1);
+}
@@ -0,0 +1,266 @@
+/*									tab:8
+ *
+ * trace.c - binary trace writer of lc3sim
+ *
+ * "Copyright (c) 2003 by Steven S. Lumetta."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright notice
+ * and the following two paragraphs appear in all copies of this software,
+ * that the files COPYING and NO_WARRANTY are included verbatim with
+ * any distribution, and that the contents of the file README are included
+ * verbatim as part of a file named README with any distribution.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE TO ANY PARTY FOR DIRECT,
+ * INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE AUTHOR
+ * HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS ON AN "AS IS"
+ * BASIS, AND THE AUTHOR NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT,
+ * UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:	    trace.c
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(USE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include "lc3sim.h"
+#include "symbol.h"
+#include "trace.h"
+
+/*
+   The simulator fills a block in memory and hands it to a writer thread,
+   which deflates it and writes it while the next one fills.  The simulator
+   waits only when all TRACE_BUFFERS blocks are queued.
+*/
+#define TRACE_BUFFERS 4
+
+typedef struct trace_block_t trace_block_t;
+struct trace_block_t {
+    unsigned char data[TRACE_BLOCK_SIZE];
+    int len;
+};
+
+int trace_on = 0;
+
+static FILE* trace_file = NULL;
+static trace_block_t trace_blocks[TRACE_BUFFERS];
+static int queued = 0, written = 0;    /* blocks handed over and written */
+static int writer_done = 0;
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t block_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t block_written = PTHREAD_COND_INITIALIZER;
+
+/* block being filled by the simulator */
+static unsigned char* out;
+static unsigned char* out_end;
+
+/* registers as of the last record */
+static int last_regs[TRACE_NUM_REGS];
+
+#define PUT8(v)  (*out++ = (v))
+#define PUT16(v) (out[0] = ((v) >> 8) & 0xFF, out[1] = (v) & 0xFF, out += 2)
+
+static void
+put32 (unsigned char* p, unsigned long v)
+{
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static void
+write_block (trace_block_t* b)
+{
+    unsigned char head[8];
+    const unsigned char* data = b->data;
+    unsigned long stored = b->len;
+#if defined(USE_ZLIB)
+    static unsigned char packed[TRACE_BLOCK_SIZE + TRACE_BLOCK_SIZE / 512 + 64];
+    uLongf packed_len = sizeof (packed);
+
+    if (compress2 (packed, &packed_len, b->data, b->len, 1) == Z_OK &&
+        packed_len < (uLongf)b->len) {
+	data = packed;
+	stored = packed_len;
+    }
+#endif
+    put32 (head, b->len);
+    put32 (head + 4, stored);
+    fwrite (head, 1, sizeof (head), trace_file);
+    fwrite (data, 1, stored, trace_file);
+}
+
+static void*
+run_writer (void* arg)
+{
+    pthread_mutex_lock (&lock);
+    for (;;) {
+	while (written == queued && !writer_done)
+	    pthread_cond_wait (&block_queued, &lock);
+	if (written == queued)
+	    break;
+	pthread_mutex_unlock (&lock);
+	write_block (&trace_blocks[written % TRACE_BUFFERS]);
+	pthread_mutex_lock (&lock);
+	written++;
+	pthread_cond_signal (&block_written);
+    }
+    pthread_mutex_unlock (&lock);
+    return NULL;
+}
+
+/* Hand the block being filled to the writer and start the next one. */
+static void
+flush_block ()
+{
+    trace_block_t* b = &trace_blocks[queued % TRACE_BUFFERS];
+
+    b->len = out - b->data;
+    if (b->len == 0)
+        return;
+    pthread_mutex_lock (&lock);
+    queued++;
+    pthread_cond_signal (&block_queued);
+    while (queued - written == TRACE_BUFFERS)
+	pthread_cond_wait (&block_written, &lock);
+    pthread_mutex_unlock (&lock);
+
+    out = trace_blocks[queued % TRACE_BUFFERS].data;
+    out_end = out + TRACE_BLOCK_SIZE - TRACE_MAX_RECORD;
+}
+
+#define RESERVE() if (out > out_end) flush_block ()
+
+int
+trace_open (const char* filename)
+{
+    unsigned char head[6];
+    int addr;
+
+    trace_close ();
+    if ((trace_file = fopen (filename, "wb")) == NULL)
+        return -1;
+    memcpy (head, TRACE_MAGIC, 4);
+    head[4] = TRACE_VERSION;
+#if defined(USE_ZLIB)
+    head[5] = TRACE_DEFLATE;
+#else
+    head[5] = 0;
+#endif
+    fwrite (head, 1, sizeof (head), trace_file);
+
+    queued = written = writer_done = 0;
+    if (pthread_create (&writer, NULL, run_writer, NULL) != 0) {
+	fclose (trace_file);
+	trace_file = NULL;
+	return -1;
+    }
+    out = trace_blocks[0].data;
+    out_end = out + TRACE_BLOCK_SIZE - TRACE_MAX_RECORD;
+    memset (last_regs, 0, sizeof (last_regs));
+    last_regs[TRACE_PC] = -1;    /* the first fetch has its PC */
+    trace_on = 1;
+
+    for (addr = 0; addr < 65536; addr++)
+	if (lc3_sym_names[addr] != NULL)
+	    trace_symbol (addr, lc3_sym_names[addr]->name);
+
+    return 0;
+}
+
+void
+trace_close ()
+{
+    if (!trace_on)
+        return;
+    trace_on = 0;
+    flush_block ();
+    pthread_mutex_lock (&lock);
+    writer_done = 1;
+    pthread_cond_signal (&block_queued);
+    pthread_mutex_unlock (&lock);
+    pthread_join (writer, NULL);
+    fclose (trace_file);
+    trace_file = NULL;
+}
+
+void
+trace_fetch (int pc, int inst, int breakpoint)
+{
+    RESERVE ();
+    pc &= 0xFFFF;
+    if (pc == last_regs[TRACE_PC]) {
+	PUT8 (TRACE_INST_NEXT | (breakpoint ? TRACE_BREAKPOINT : 0));
+    } else {
+	PUT8 (TRACE_INST | (breakpoint ? TRACE_BREAKPOINT : 0));
+	PUT16 (pc);
+    }
+    PUT16 (inst);
+    last_regs[TRACE_PC] = (pc + 1) & 0xFFFF;
+}
+
+void
+trace_access (trace_tag_t tag, int addr, int value)
+{
+    RESERVE ();
+    PUT8 (tag);
+    PUT16 (addr);
+    PUT16 (value);
+}
+
+void
+trace_registers (const int* regs)
+{
+    int values[TRACE_NUM_REGS];
+    unsigned char* mask;
+    int i, changed = 0;
+
+    for (i = 0; i < R_PC; i++)
+	values[TRACE_R0 + i] = regs[i] & 0xFFFF;
+    values[TRACE_PC] = regs[R_PC] & 0xFFFF;
+    values[TRACE_PSR] = regs[R_PSR] & 0xFFFF;
+
+    RESERVE ();
+    PUT8 (TRACE_REGS);
+    mask = out;
+    out += 2;
+    for (i = 0; i < TRACE_NUM_REGS; i++) {
+	if (values[i] != last_regs[i]) {
+	    changed |= 1 << i;
+	    last_regs[i] = values[i];
+	    PUT16 (values[i]);
+	}
+    }
+    mask[0] = changed >> 8;
+    mask[1] = changed & 0xFF;
+}
+
+void
+trace_symbol (int addr, const char* name)
+{
+    int len = (name == NULL ? 0 : strlen (name));
+
+    if (len > 255)
+        len = 255;
+    RESERVE ();
+    PUT8 (TRACE_SYMBOL);
+    PUT16 (addr);
+    PUT8 (len);
+    if (len > 0)
+	memcpy (out, name, len);
+    out += len;
+}
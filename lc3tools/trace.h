@@ -0,0 +1,88 @@
+/*									tab:8
+ *
+ * trace.h - binary execution trace of lc3sim, decoded by lc3trace
+ *
+ * "Copyright (c) 2003 by Steven S. Lumetta."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written
+ * agreement is hereby granted, provided that the above copyright notice
+ * and the following two paragraphs appear in all copies of this software,
+ * that the files COPYING and NO_WARRANTY are included verbatim with
+ * any distribution, and that the contents of the file README are included
+ * verbatim as part of a file named README with any distribution.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE TO ANY PARTY FOR DIRECT,
+ * INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE AUTHOR
+ * HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE AUTHOR SPECIFICALLY DISCLAIMS ANY WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS ON AN "AS IS"
+ * BASIS, AND THE AUTHOR NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT,
+ * UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ * Filename:	    trace.h
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+   A trace file starts with TRACE_MAGIC, the version and the flags, and
+   continues with blocks of records.  Each block has a header of two big
+   endian 32-bit words: the size of the records and the size stored in the
+   file.  A block is deflated (zlib) when the stored size is smaller.  The
+   records never cross a block.
+
+   The 16-bit values of the records are big endian.  Each record starts
+   with its tag:
+
+     TRACE_INST        PC IR   fetch of the instruction IR at PC
+     TRACE_INST_NEXT   IR      same, at the PC following the last record
+     TRACE_READ        ADDR VALUE
+     TRACE_WRITE       ADDR VALUE
+     TRACE_REGS        MASK VALUE...
+                               end of the instruction: the registers of
+                               MASK (bit i for trace_reg_t i) that differ
+                               from the last record, with the PC of the
+                               next instruction (PC + 1) assumed
+     TRACE_SYMBOL      ADDR LENGTH NAME
+                               label at ADDR (removed if LENGTH is 0)
+
+   TRACE_BREAKPOINT is or'ed to the fetch tags for the instructions with a
+   user breakpoint.
+*/
+
+#define TRACE_MAGIC      "LC3T"
+#define TRACE_VERSION    1
+#define TRACE_DEFLATE    0x01     /* blocks may be deflated */
+
+#define TRACE_BLOCK_SIZE 65536
+#define TRACE_MAX_RECORD 300      /* symbol record with the longest name */
+
+typedef enum trace_tag_t trace_tag_t;
+enum trace_tag_t {
+    TRACE_INST = 1, TRACE_INST_NEXT, TRACE_READ, TRACE_WRITE, TRACE_REGS,
+    TRACE_SYMBOL,
+    TRACE_BREAKPOINT = 0x80
+};
+
+/* registers of TRACE_REGS */
+typedef enum trace_reg_t trace_reg_t;
+enum trace_reg_t {
+    TRACE_R0 = 0, TRACE_PC = 8, TRACE_PSR, TRACE_NUM_REGS
+};
+
+/* writer, in trace.c */
+extern int trace_on;
+
+extern int trace_open (const char* filename);
+extern void trace_close ();
+extern void trace_fetch (int pc, int inst, int breakpoint);
+extern void trace_access (trace_tag_t tag, int addr, int value);
+extern void trace_registers (const int* regs);
+extern void trace_symbol (int addr, const char* name);
+
+#endif /* TRACE_H */